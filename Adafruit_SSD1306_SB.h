@@ -0,0 +1,444 @@
+// SSD1306 driver of the V2 board: own frame (or page) buffer, changed page
+// and column window flushing and a background flush over TWI. Included by
+// TinyReflowController.cpp with the display library, once SCREEN_WIDTH,
+// SCREEN_HEIGHT, OLED_PAGES, OLED_SEGMENTS, OLED_PAGE_MODE and
+// OLED_ASYNC_FLUSH are defined.
+#ifndef ADAFRUIT_SSD1306_SB_H
+#define ADAFRUIT_SSD1306_SB_H
+
+#if OLED_PAGE_MODE
+// Single page, the scene is drawn again for each of them
+uint8_t SSD1306_SFB[SCREEN_WIDTH];
+#else
+uint8_t SSD1306_SFB[SCREEN_WIDTH * ((SCREEN_HEIGHT + 7) / 8)];
+#endif
+class Adafruit_SSD1306_SB : public Adafruit_SSD1306
+{
+public:
+  Adafruit_SSD1306_SB(uint8_t w, uint8_t h, TwoWire* twi = &Wire,
+    int8_t rst_pin = -1, uint32_t clkDuring = 400000UL,
+    uint32_t clkAfter = 100000UL) : Adafruit_SSD1306(w, h, twi, rst_pin, clkDuring, clkAfter)
+  {
+    buffer = SSD1306_SFB;
+    invalidate();
+#if OLED_PAGE_MODE
+    renderPage = OLED_PAGES;
+#endif
+#if OLED_ASYNC_FLUSH
+    flushing = false;
+#endif
+  }
+  ~Adafruit_SSD1306_SB(void)
+  {
+    buffer = NULL;
+  }
+
+  // Drawing color, for the display backend that is also compiled for boards
+  // without this library
+  static constexpr uint16_t foreground = WHITE;
+
+#if OLED_PAGE_MODE
+  // Library begin() clears a full frame buffer, send the init sequence of a
+  // 128x64 panel here instead
+  bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t addr = 0x3C)
+  {
+    static const uint8_t init[] PROGMEM = {
+      SSD1306_DISPLAYOFF,
+      SSD1306_SETDISPLAYCLOCKDIV, 0x80,
+      SSD1306_SETMULTIPLEX, SCREEN_HEIGHT - 1,
+      SSD1306_SETDISPLAYOFFSET, 0x00,
+      SSD1306_SETSTARTLINE | 0x00,
+      SSD1306_MEMORYMODE, 0x00,
+      SSD1306_SEGREMAP | 0x01,
+      SSD1306_COMSCANDEC,
+      SSD1306_SETCOMPINS, 0x12,
+      SSD1306_SETVCOMDETECT, 0x40,
+      SSD1306_DISPLAYALLON_RESUME,
+      SSD1306_NORMALDISPLAY,
+      SSD1306_DEACTIVATE_SCROLL
+    };
+    bool external = (switchvcc == SSD1306_EXTERNALVCC);
+
+    vccstate = switchvcc;
+    i2caddr = addr;
+    wire->begin();
+    wire->setClock(wireClk);
+    ssd1306_commandList(init, sizeof(init));
+    ssd1306_command1(SSD1306_CHARGEPUMP);
+    ssd1306_command1(external ? 0x10 : 0x14);
+    ssd1306_command1(SSD1306_SETCONTRAST);
+    ssd1306_command1(external ? 0x9F : 0xCF);
+    ssd1306_command1(SSD1306_SETPRECHARGE);
+    ssd1306_command1(external ? 0x22 : 0xF1);
+    ssd1306_command1(SSD1306_DISPLAYON);
+    wire->setClock(restoreClk);
+
+    return true;
+  }
+
+  // Start a frame, drawing calls only land in the current page
+  void firstPage(void)
+  {
+    renderPage = 0;
+    clearDisplay();
+  }
+
+  // Move on to the next page once the current one is sent, false when the
+  // frame is complete
+  bool nextPage(void)
+  {
+    if (renderPage >= OLED_PAGES) return false;
+    if (++renderPage >= OLED_PAGES) return false;
+    clearDisplay();
+
+    return true;
+  }
+
+  // Frame started and not all pages sent yet
+  bool rendering(void)
+  {
+    return renderPage < OLED_PAGES;
+  }
+
+  void clearDisplay(void)
+  {
+    memset(buffer, 0, SCREEN_WIDTH);
+  }
+
+  // Drawing primitives clipped to the current page, rotation is not used
+  void drawPixel(int16_t x, int16_t y, uint16_t color)
+  {
+    if ((x < 0) || (x >= SCREEN_WIDTH) || (y < 0) || ((y >> 3) != renderPage)) return;
+    pageWrite(x, 1 << (y & 7), color);
+  }
+
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+  {
+    if ((y < 0) || ((y >> 3) != renderPage)) return;
+    if (x < 0)
+    {
+      w += x;
+      x = 0;
+    }
+    if ((x + w) > SCREEN_WIDTH) w = SCREEN_WIDTH - x;
+    while (w-- > 0)
+    {
+      pageWrite(x++, 1 << (y & 7), color);
+    }
+  }
+
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+  {
+    int16_t top = renderPage * 8;
+    int16_t first = max(y, top) - top;
+    int16_t last = min(y + h, top + 8) - top;
+
+    if ((x < 0) || (x >= SCREEN_WIDTH) || (first >= last)) return;
+    pageWrite(x, ((1 << last) - 1) & ~((1 << first) - 1), color);
+  }
+#else
+  bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t addr = 0x3C)
+  {
+    return Adafruit_SSD1306::begin(switchvcc, addr);
+  }
+
+  // Whole frame buffer, a single page pass
+  void firstPage(void)
+  {
+    clearDisplay();
+  }
+
+  bool nextPage(void)
+  {
+    return false;
+  }
+
+  bool rendering(void)
+  {
+    return false;
+  }
+#endif
+
+  // Force every page to be sent on the next flush (display RAM unknown)
+  void invalidate(void)
+  {
+    stalePages = 0xFF;
+  }
+
+  // Only push the pages (and column window within each page) whose content
+  // changed since the last flush. A CRC per segment of each page is kept
+  // instead of a shadow copy of the frame buffer to spare SRAM, a segment
+  // whose CRC collides is sent with the next invalidate().
+  void display(void)
+  {
+    uint8_t page;
+    uint8_t last;
+    uint8_t columnStart;
+    uint8_t columnEnd;
+
+    pageRange(page, last);
+    for (; page <= last; page++)
+    {
+      if (pageWindow(page, columnStart, columnEnd))
+      {
+        displayWindow(page, columnStart, columnEnd);
+      }
+    }
+  }
+
+#if OLED_ASYNC_FLUSH
+  // Start sending the changed pages in the background. The Wire TWI ISR
+  // streams each chunk while displayBusy() queues the next one. Returns false
+  // if the previous flush has not completed yet.
+  bool displayAsync(void)
+  {
+    if (flushing) return false;
+
+    wire->setClock(wireClk);
+    // Bus time of a byte (8 bits + ACK) rounded up, in microseconds
+    flushByteTime = (9000000UL + wireClk - 1) / wireClk;
+    pageRange(flushPage, flushLast);
+    // Incremented before use
+    flushPage--;
+    flushColumn = 1;
+    flushColumnEnd = 0;
+    flushChunkTime = 0;
+    flushing = true;
+    displayBusy();
+
+    return true;
+  }
+
+  // Check whether the background flush is still running. Must be called
+  // regularly from loop() as it also hands over the next chunk to the TWI
+  // once the previous one had time to leave the bus.
+  bool displayBusy(void)
+  {
+    uint8_t chunk[TWI_BUFFER_LENGTH];
+    uint8_t length;
+
+    if (!flushing) return false;
+
+    // Previous chunk is still being shifted out by the TWI ISR. Should the
+    // estimate be short, twi_writeTo() only waits for the remaining bytes.
+    if ((micros() - flushChunkStart) < flushChunkTime) return true;
+
+    if (flushColumn > flushColumnEnd)
+    {
+      // Window completed, move on to the next page with changes
+      do
+      {
+        if (++flushPage > flushLast)
+        {
+          wire->setClock(restoreClk);
+          flushing = false;
+          return false;
+        }
+      } while (!pageWindow(flushPage, flushColumn, flushColumnEnd));
+
+      chunk[0] = 0x00;
+      chunk[1] = SSD1306_PAGEADDR;
+      chunk[2] = flushPage;
+      chunk[3] = flushPage;
+      chunk[4] = SSD1306_COLUMNADDR;
+      chunk[5] = flushColumn;
+      chunk[6] = flushColumnEnd;
+      length = 7;
+    }
+    else
+    {
+      uint8_t *ptr = pageBuffer(flushPage) + flushColumn;
+
+      chunk[0] = 0x40;
+      length = 1;
+      while ((length < TWI_BUFFER_LENGTH) && (flushColumn <= flushColumnEnd))
+      {
+        chunk[length++] = *ptr++;
+        flushColumn++;
+      }
+    }
+
+    twi_writeTo(i2caddr, chunk, length, false, true);
+    flushChunkStart = micros();
+    // Address byte, payload and start/stop conditions
+    flushChunkTime = (length + 2) * flushByteTime;
+
+    return true;
+  }
+#endif
+
+  // Copy a page-major PROGMEM image into the buffer, each page row being
+  // width columns followed by a fill byte for the rest of the page. Meant
+  // for a freshly cleared buffer, content below is overwritten.
+  void drawPages(const uint8_t *image, uint8_t pageFirst, uint8_t pageCount, uint8_t width)
+  {
+    uint8_t page;
+    uint8_t last;
+
+    pageRange(page, last);
+    for (; page <= last; page++)
+    {
+      const uint8_t *row;
+      uint8_t *ptr = pageBuffer(page);
+
+      if ((page < pageFirst) || (page >= (pageFirst + pageCount))) continue;
+      row = image + (page - pageFirst) * (width + 1);
+      memcpy_P(ptr, row, width);
+      memset(ptr + width, pgm_read_byte(row + width), SCREEN_WIDTH - width);
+    }
+  }
+
+  // Write PROGMEM columns straight into a page, clipped to the screen
+  void drawColumns(int16_t x, uint8_t page, const uint8_t *columns, uint8_t width)
+  {
+    uint8_t first;
+    uint8_t last;
+    uint8_t *ptr;
+
+    pageRange(first, last);
+    if ((page < first) || (page > last)) return;
+    ptr = pageBuffer(page);
+    for (; width > 0; width--, x++, columns++)
+    {
+      if ((x >= 0) && (x < SCREEN_WIDTH)) ptr[x] = pgm_read_byte(columns);
+    }
+  }
+
+private:
+#if OLED_PAGE_MODE
+  void pageWrite(uint8_t x, uint8_t mask, uint16_t color)
+  {
+    switch (color)
+    {
+      case WHITE:
+        buffer[x] |= mask;
+        break;
+
+      case BLACK:
+        buffer[x] &= ~mask;
+        break;
+
+      case INVERSE:
+        buffer[x] ^= mask;
+        break;
+    }
+  }
+#endif
+
+  // Pages held by the buffer, inclusive
+  void pageRange(uint8_t &first, uint8_t &last)
+  {
+#if OLED_PAGE_MODE
+    first = renderPage;
+    last = renderPage;
+#else
+    first = 0;
+    last = OLED_PAGES - 1;
+#endif
+  }
+
+  uint8_t *pageBuffer(uint8_t page)
+  {
+#if OLED_PAGE_MODE
+    (void)page;
+    return buffer;
+#else
+    return &buffer[page * SCREEN_WIDTH];
+#endif
+  }
+
+  // Compute the column window of a page that changed since the last flush.
+  // Returns false if the page is unchanged.
+  bool pageWindow(uint8_t page, uint8_t &columnStart, uint8_t &columnEnd)
+  {
+    uint8_t *ptr = pageBuffer(page);
+    uint8_t segmentFirst = OLED_SEGMENTS;
+    uint8_t segmentLast = 0;
+    uint8_t segment;
+
+    for (segment = 0; segment < OLED_SEGMENTS; segment++)
+    {
+      uint16_t digest = 0xFFFF;
+      uint8_t count;
+
+      for (count = 0; count < OLED_SEGMENT_WIDTH; count++)
+      {
+        digest = _crc16_update(digest, *ptr++);
+      }
+
+      if ((stalePages & (1 << page)) ||
+          (digest != pageDigest[page][segment]))
+      {
+        pageDigest[page][segment] = digest;
+        if (segmentFirst == OLED_SEGMENTS) segmentFirst = segment;
+        segmentLast = segment;
+      }
+    }
+    stalePages &= ~(1 << page);
+
+    // Page unchanged since last flush
+    if (segmentFirst == OLED_SEGMENTS) return false;
+
+    columnStart = segmentFirst * OLED_SEGMENT_WIDTH;
+    columnEnd = ((segmentLast + 1) * OLED_SEGMENT_WIDTH) - 1;
+
+    return true;
+  }
+
+  // Send a single page between the column start and end (inclusive)
+  void displayWindow(uint8_t page, uint8_t columnStart, uint8_t columnEnd)
+  {
+    uint8_t *ptr = pageBuffer(page) + columnStart;
+    uint8_t count = columnEnd - columnStart + 1;
+    uint8_t bytesOut;
+
+    wire->setClock(wireClk);
+    // Set up the GDDRAM window in a single command transaction
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x00);
+    wire->write((uint8_t)SSD1306_PAGEADDR);
+    wire->write(page);
+    wire->write(page);
+    wire->write((uint8_t)SSD1306_COLUMNADDR);
+    wire->write(columnStart);
+    wire->write(columnEnd);
+    wire->endTransmission();
+
+    // Stream the window data, limited by the Wire library buffer size
+    wire->beginTransmission(i2caddr);
+    wire->write((uint8_t)0x40);
+    bytesOut = 1;
+    while (count--)
+    {
+      if (bytesOut >= BUFFER_LENGTH)
+      {
+        wire->endTransmission();
+        wire->beginTransmission(i2caddr);
+        wire->write((uint8_t)0x40);
+        bytesOut = 1;
+      }
+      wire->write(*ptr++);
+      bytesOut++;
+    }
+    wire->endTransmission();
+    wire->setClock(restoreClk);
+  }
+
+  uint16_t pageDigest[OLED_PAGES][OLED_SEGMENTS];
+  uint8_t stalePages;
+#if OLED_PAGE_MODE
+  uint8_t renderPage;
+#endif
+#if OLED_ASYNC_FLUSH
+  bool flushing;
+  uint8_t flushPage;
+  uint8_t flushLast;
+  uint8_t flushColumn;
+  uint8_t flushColumnEnd;
+  uint8_t flushByteTime;
+  uint16_t flushChunkTime;
+  unsigned long flushChunkStart;
+#endif
+};
+
+#endif
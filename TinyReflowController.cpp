@@ -127,20 +127,40 @@
 
 // ***** CONSTANTS *****
 // ***** GENERAL *****
-#define VERSION 2 // Replace with 1 or 2
+#define VERSION 2 // Replace with 1 or 2, selects the board traits
+#define PID_FIXED_POINT 1 // Replace with 0 to use the double precision PID_v1
+#define PROFILING 0 // Replace with 1 to collect loop timing statistics
+#define THERMAL_MODEL 0 // Replace with 1 for model based feed-forward and peak cutoff
+#define SENSOR_CHANNELS 1 // MAX31856 probes on the SPI bus, see thermocoupleCSPins
+#define RUN_LOG 0 // Replace with 1 to record runs on an SPI NOR flash (V2)
+#define IDLE_SLEEP 1 // Replace with 0 to keep loop() spinning between tasks
+#ifndef BENCHMARK
+#define BENCHMARK 0 // Replace with 1 (or build env:benchmark) to run the cycle benchmark
+#endif
 
 // ***** INCLUDES *****
 #include <SPI.h>
 #include <Wire.h>
 #include <EEPROM.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
 #if VERSION == 1
 #include <LiquidCrystal.h>
 #elif VERSION == 2
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
+extern "C" {
+#include <utility/twi.h>
+}
 #endif
 #include <Adafruit_MAX31856.h> 
+#if !PID_FIXED_POINT
 #include <PID_v1.h>
+#endif
+#if IDLE_SLEEP || BENCHMARK
+#include <avr/sleep.h>
+#endif
 
 // ***** TYPE DEFINITIONS *****
 typedef enum REFLOW_STATE : uint8_t
@@ -153,7 +173,9 @@ typedef enum REFLOW_STATE : uint8_t
   REFLOW_STATE_COMPLETE,
   REFLOW_STATE_TOO_HOT,
   REFLOW_STATE_ERROR,
-  REFLOW_STATE_BAKE
+  REFLOW_STATE_BAKE,
+  REFLOW_STATE_TUNE,
+  REFLOW_STATE_REARM
 } reflowState_t;
 
 typedef enum REFLOW_STATUS : uint8_t
@@ -180,60 +202,624 @@ typedef enum REFLOW_PROFILE : uint8_t
 {
   REFLOW_PROFILE_LEADFREE,
   REFLOW_PROFILE_LEADED,
-  REFLOW_PROFILE_BAKE
+  REFLOW_PROFILE_BAKE,
+  // Segments stored in the settings, empty until uploaded
+  REFLOW_PROFILE_CUSTOM,
+  REFLOW_PROFILE_COUNT
 } reflowProfile_t;
 
+typedef enum SEGMENT_EXIT : uint8_t
+{
+  // Input reaches target less margin
+  SEGMENT_EXIT_ABOVE,
+  // Input falls to target plus margin
+  SEGMENT_EXIT_BELOW,
+  // Setpoint ramped to target at rate
+  SEGMENT_EXIT_RAMP,
+  // Target held for a time
+  SEGMENT_EXIT_HOLD,
+  // Target held until cancelled
+  SEGMENT_EXIT_NEVER
+} segmentExit_t;
+
+typedef enum PID_GAIN_SET : uint8_t
+{
+  PID_GAINS_PREHEAT,
+  PID_GAINS_SOAK,
+  PID_GAINS_REFLOW,
+  PID_GAINS_BAKE,
+  PID_GAINS_COUNT
+} pidGainSet_t;
+
+typedef struct REFLOW_SEGMENT
+{
+  // Stage shown while the segment runs
+  reflowState_t stage;
+  pidGainSet_t gains;
+  segmentExit_t exit;
+  // Target temperature (degree Celsius)
+  int16_t target;
+  // Margin (degree Celsius) for ABOVE/BELOW, rate (degree Celsius per hour)
+  // for RAMP, time (s) for HOLD
+  int16_t parameter;
+} __attribute__((packed)) reflowSegment_t;
+
+typedef struct REFLOW_PROFILE_ENTRY
+{
+  char name[3];
+  // Segment range in reflowSegments
+  uint8_t first;
+  uint8_t count;
+} reflowProfileEntry_t;
+
+typedef struct THERMOCOUPLE_SAMPLE
+{
+  // Linearized thermocouple temperature (LSB = 1/128 degree Celsius)
+  int32_t temperature;
+  // Fault status register
+  uint8_t fault;
+} __attribute__((packed)) thermocoupleSample_t;
+
+// How the channels make up the control input
+typedef enum SENSOR_INPUT : uint8_t
+{
+  SENSOR_INPUT_CHANNEL, // Selected channel only
+  SENSOR_INPUT_MIN,
+  SENSOR_INPUT_MAX,
+  SENSOR_INPUT_AVERAGE // Weighted by sensorWeights
+} sensorInput_t;
+
+typedef enum TELEMETRY_MODE : uint8_t
+{
+  TELEMETRY_CSV,
+  TELEMETRY_BINARY
+} telemetryMode_t;
+
+// Binary telemetry frame, multi-byte fields are little-endian
+typedef struct TELEMETRY_FRAME
+{
+  uint8_t sync;
+  uint8_t version;
+  uint8_t sequence;
+  // Reflow state (bits 3:0) and profile (bits 7:4)
+  uint8_t status;
+  uint8_t fault;
+  // Records dropped so far due to serial back-pressure (modulo 256)
+  uint8_t dropped;
+  // Seconds since start of reflow
+  uint16_t time;
+  // Temperatures in 1/16 degree Celsius, filtered input and raw sample
+  int16_t setpoint;
+  int16_t input;
+  int16_t raw;
+  // SSR on time within window (ms)
+  uint16_t duty;
+  // Unfiltered sample (1/16 degree Celsius) and fault status of each channel
+  int16_t channel[SENSOR_CHANNELS];
+  uint8_t channelFault[SENSOR_CHANNELS];
+  // CRC-16/CCITT-FALSE of all preceding bytes
+  uint16_t crc;
+} __attribute__((packed)) telemetryFrame_t;
+
+// Run index entry, sector 0 of the run log flash
+typedef struct RUN_LOG_ENTRY
+{
+  // Erased (0xFFFF) past the last run
+  uint16_t run;
+  // Page of the first record
+  uint16_t page;
+  // reflowProfile_t, REFLOW_PROFILE_COUNT for a tune run
+  uint8_t profile;
+  // Record format, TELEMETRY_VERSION and sizeof(telemetryFrame_t)
+  uint8_t version;
+  uint8_t recordSize;
+  // Final reflowState, programmed when the run ends, erased if it never did
+  uint8_t result;
+} __attribute__((packed)) runLogEntry_t;
+
+typedef enum MODEL_PHASE : uint8_t
+{
+  MODEL_IDLE,
+  // Waiting for the oven to respond after start
+  MODEL_LAG,
+  // Collecting heating slopes
+  MODEL_FIT,
+  MODEL_VALID
+} modelPhase_t;
+
+typedef enum TASK_PRIORITY : uint8_t
+{
+  TASK_PRIORITY_CONTROL,
+  TASK_PRIORITY_NORMAL,
+  TASK_PRIORITY_DISPLAY
+} taskPriority_t;
+
+#if PROFILING
+typedef enum PROFILE_SECTION : uint8_t
+{
+  PROFILE_LOOP,
+  PROFILE_SENSOR,
+  PROFILE_PID,
+  PROFILE_REFLOW,
+  PROFILE_RENDER,
+  PROFILE_FLUSH,
+  PROFILE_SECTIONS
+} profileSection_t;
+
+typedef struct PROFILE_STATS
+{
+  unsigned long count;
+  unsigned long total;
+  unsigned long min;
+  unsigned long max;
+} profileStats_t;
+
+// Time a section of code in microseconds (8 us resolution @ 8 MHz)
+#define PROFILE_START(section) unsigned long profileStart_##section = micros()
+#define PROFILE_END(section) \
+  profileRecord(section, micros() - profileStart_##section)
+#else
+#define PROFILE_START(section)
+#define PROFILE_END(section)
+#endif
+
+#if BENCHMARK
+typedef struct BENCH
+{
+  PGM_P name;
+  // One run of the path, timed between benchBegin() and benchEnd()
+  void (*run)(void);
+} bench_t;
+#endif
+
+// Values shown on the display, a redraw is due when they change. Every page
+// of a frame is rendered from this copy, the last plot column included.
+typedef struct DISPLAY_SNAPSHOT
+{
+  int32_t temperature;
+  reflowState_t state;
+  reflowProfile_t profile;
+  uint8_t fault;
+  uint8_t plotCount;
+  uint8_t plotTop;
+  uint8_t plotBottom;
+  unsigned int plotSpan;
+} __attribute__((packed)) displaySnapshot_t;
+
+typedef struct TASK
+{
+  // Period in ms, 0 to poll on every scheduler pass
+  unsigned int period;
+  // Display tasks are skipped while control tasks are late
+  taskPriority_t priority;
+  // Next deadline, first one relative to start-up
+  unsigned long deadline;
+  void (*callback)(void);
+} task_t;
+
 // ***** GENERAL PROFILE CONSTANTS *****
+// Profile byte written by earlier firmware, only read when no settings exist
 #define PROFILE_TYPE_ADDRESS 0
 #define TEMPERATURE_ROOM 50
 #define TEMPERATURE_SOAK_MIN 150
 #define TEMPERATURE_COOL_MIN 100
+#define TEMPERATURE_REFLOW_MARGIN 5
 #define SENSOR_SAMPLING_TIME 1000
-#define SOAK_TEMPERATURE_STEP 5
+// Formatted temperature, "-6553.5" and terminator
+#define TEMPERATURE_TEXT_SIZE 8
+// Ramp segments advance the setpoint once per period (ms)
+#define SEGMENT_RAMP_PERIOD 1000
+// Ramp rate of STEP degree Celsius every PERIOD ms in degree per hour, the
+// setpoint keeps the remainder of each 1/16 degree step so the rate is exact
+#define SEGMENT_RATE(step, period) ((int16_t)(((step) * 3600000L) / (period)))
+#define SEGMENT_RATE_EXACT(step, period) ((((step) * 3600000L) % (period)) == 0)
 
 // ***** LEAD FREE PROFILE CONSTANTS *****
 #define TEMPERATURE_SOAK_MAX_LF 200
 #define TEMPERATURE_REFLOW_MAX_LF 250
-#define SOAK_MICRO_PERIOD_LF 9000
+#define SOAK_RAMP_RATE_LF SEGMENT_RATE(5, 9000)
+static_assert(SEGMENT_RATE_EXACT(5, 9000), "Lead-free soak rate is not a whole degree per hour");
 
 // ***** LEADED PROFILE CONSTANTS *****
 #define TEMPERATURE_SOAK_MAX_PB 180
 #define TEMPERATURE_REFLOW_MAX_PB 224
-#define SOAK_MICRO_PERIOD_PB 10000
+#define SOAK_RAMP_RATE_PB SEGMENT_RATE(5, 10000)
+static_assert(SEGMENT_RATE_EXACT(5, 10000), "Leaded soak rate is not a whole degree per hour");
 
 // ***** BAKE PROFILE CONSTANTS *****
 #define TEMPERATURE_BAKE 120
 
+// ***** BATCH CONSTANTS *****
+#define BATCH_QUEUE_SIZE 8 // Queued profile runs
+// Between runs the oven cools down, or pre-warms, to this temperature and
+// is held there, the next run may start once within the margin
+#define BATCH_REARM_TEMPERATURE 100
+#define BATCH_REARM_MARGIN 5
+
+// ***** SSR SPECIFIC CONSTANTS *****
+// Time proportioning window (ms), Timer1 interrupt fires every millisecond
+#define SSR_WINDOW_SIZE 2000
+// Set to 1 to spread on time evenly over mains half-cycles instead of a
+// single pulse per window (zero-cross SSR only)
+#define SSR_BURST_FIRE 0
+#define SSR_HALF_CYCLE 10 // Mains half-cycle (ms), 10 for 50 Hz, 8 for 60 Hz
+// Timer1 interrupt registers are shared with other timers on the ATtiny1634
+#if defined(TIMSK1)
+#define TIMER1_MASK TIMSK1
+#define TIMER1_FLAGS TIFR1
+#else
+#define TIMER1_MASK TIMSK
+#define TIMER1_FLAGS TIFR
+#endif
+
+// ***** FAN SPECIFIC CONSTANTS *****
+// Drive period (ms) with 1 ms steps, short to PWM a DC fan through a MOSFET,
+// around SSR_WINDOW_SIZE for a mains fan on a relay
+#define FAN_WINDOW_SIZE 20
+// Target cool-down rate (degree Celsius per second) during the cool stage,
+// kept below the thermal shock limit of the parts. 0 leaves the fan off.
+#define FAN_COOL_RATE 3.0
+// Duty (%) ceiling, and circulation duty (%) while baking, 0 to disable
+#define FAN_DUTY_LIMIT 100
+#define FAN_BAKE_DUTY 30
+// Rate PI gains, duty (%) per degree Celsius per second of rate error and
+// its increase per sample
+#define FAN_KP 20
+#define FAN_KI 5
+// Cool-down rate IIR time constant of 2^FAN_RATE_SHIFT PID samples
+#define FAN_RATE_SHIFT 2
+#define FAN_COOL_RATE_Q4 ((int16_t)(FAN_COOL_RATE * 16))
+#define FAN_DUTY(percent) ((unsigned int)(((unsigned long)(percent) * FAN_WINDOW_SIZE) / 100))
+
+// ***** SENSOR SPECIFIC CONSTANTS *****
+// Mains rejection of the MAX31856 notch filter, 1 for 50 Hz or 0 for 60 Hz
+#define SENSOR_NOTCH_50HZ 0
+// MAX31856 hardware averaging of 1, 2, 4, 8 or 16 conversions per result
+#define SENSOR_AVERAGING 1
+// Continuous conversion period of the MAX31856 (max 82 ms or 98 ms with the
+// 60 Hz or 50 Hz filter, plus 16.7 ms or 20 ms per averaged conversion)
+#define SENSOR_CONVERSION_TIME ((SENSOR_NOTCH_50HZ ? 110 : 100) + \
+                                (SENSOR_AVERAGING - 1) * (SENSOR_NOTCH_50HZ ? 20 : 17))
+#define SENSOR_AVERAGING_SELECT ((SENSOR_AVERAGING >= 16) ? 4 : (SENSOR_AVERAGING >= 8) ? 3 : \
+                                 (SENSOR_AVERAGING >= 4) ? 2 : (SENSOR_AVERAGING >= 2) ? 1 : 0)
+// Firmware filtering of every conversion before the PID: median of the last
+// SENSOR_MEDIAN samples (0, 3 or 5) followed by an IIR low pass with a time
+// constant of 2^SENSOR_IIR_SHIFT conversions (0 to disable)
+#define SENSOR_MEDIAN 3
+#define SENSOR_IIR_SHIFT 2
+// Set to 1 if the MAX31856 DRDY output is wired to thermocoupleDrdyPin
+// (single channel only)
+#define SENSOR_DRDY 0
+// Set to 1 if the MAX31856 FAULT outputs (open drain, any number of channels
+// wired together) go to thermocoupleFaultPin, a fault then switches the SSR
+// off from the pin change interrupt instead of on the next sample (V2 only)
+#define SENSOR_FAULT_INTERRUPT 0
+// Default control input, the "input" serial command switches at run time
+#define SENSOR_INPUT SENSOR_INPUT_CHANNEL
+#define SENSOR_INPUT_INDEX 0 // Channel used by SENSOR_INPUT_CHANNEL
+// Set to 1 to keep running on the remaining channels of the control input
+// when some of them fault, otherwise any of them faulting stops the process
+#define SENSOR_FAULT_TOLERANT 0
+// Channels are read one per period, each once per conversion
+#define SENSOR_CHANNEL_PERIOD (SENSOR_CONVERSION_TIME / SENSOR_CHANNELS)
+#define SENSOR_CR0_NOTCH_50HZ 0x01 // CR0 filter select
+// MAX31856 supports up to 5 MHz, limited to F_CPU / 2 on the AVR
+#define SENSOR_SPI_CLOCK 4000000
+// Any fault reported in the status register stops the reflow process
+#define SENSOR_FAULT_MASK (MAX31856_FAULT_CJRANGE | MAX31856_FAULT_TCRANGE | \
+                           MAX31856_FAULT_CJHIGH | MAX31856_FAULT_CJLOW | \
+                           MAX31856_FAULT_TCHIGH | MAX31856_FAULT_TCLOW | \
+                           MAX31856_FAULT_OVUV | MAX31856_FAULT_OPEN)
+
 // ***** SWITCH SPECIFIC CONSTANTS *****
 #define DEBOUNCE_PERIOD_MIN 100
+// Ladder levels raise no pin changes, it is sampled at this period (ms)
+#define SWITCH_POLL_PERIOD 10
+
+// ***** TELEMETRY SPECIFIC CONSTANTS *****
+// Default format, "csv" or "binary" serial commands switch at run time
+#define TELEMETRY_MODE TELEMETRY_CSV
+#define TELEMETRY_SYNC 0xA5
+#define TELEMETRY_VERSION 4
+// Dedicated transmit ring buffer (power of 2, 128 or more), whole records
+// are dropped rather than blocking when it is full. It holds the sample
+// records and the command replies behind the 64 byte UART buffer. A CSV
+// record takes about 30 bytes plus 7 per channel beyond the first. Page mode
+// frees the SRAM for 256 bytes on V2.
+#define TELEMETRY_BUFFER_SIZE (((VERSION == 2) && OLED_PAGE_MODE) ? 256 : 128)
+// Send a record every N PID samples
+#define TELEMETRY_DECIMATION 1
+
+// ***** RUN LOG CONSTANTS *****
+// JEDEC SPI NOR flash, records never span a page and runs start on a new one
+#define RUN_LOG_SIZE 0x100000UL // Capacity (bytes), 8 Mbit
+#define RUN_LOG_PAGE_SIZE 256
+#define RUN_LOG_SECTOR_SIZE 4096 // Holds the run index
+#define RUN_LOG_FIRST_PAGE (RUN_LOG_SECTOR_SIZE / RUN_LOG_PAGE_SIZE)
+#define RUN_LOG_PAGES ((uint16_t)(RUN_LOG_SIZE / RUN_LOG_PAGE_SIZE))
+#define RUN_LOG_RUNS (RUN_LOG_SECTOR_SIZE / sizeof(runLogEntry_t))
+#define RUN_LOG_DUMP_CHUNK 16 // Bytes moved to the telemetry buffer per pass
+#define RUN_LOG_SPI_CLOCK 4000000
+#define FLASH_WRITE_ENABLE 0x06
+#define FLASH_READ_STATUS 0x05
+#define FLASH_READ 0x03
+#define FLASH_PAGE_PROGRAM 0x02
+#define FLASH_CHIP_ERASE 0xC7
+#define FLASH_RELEASE_POWER_DOWN 0xAB
+#define FLASH_STATUS_BUSY 0x01
+
+// ***** SERIAL COMMAND CONSTANTS *****
+// Longest command line, longer lines are rejected
+#define COMMAND_BUFFER_SIZE 32
+
+// ***** BENCHMARK CONSTANTS *****
+#define BENCH_RUNS 16 // Runs of each path, min and max are reported
+#define BENCH_PAINT 0xA5 // Free SRAM fill, overwritten bytes are stack use
+#define BENCH_STACK_GUARD 16 // Bytes below the painter's own frame left alone
+
+// ***** SCHEDULER SPECIFIC CONSTANTS *****
+// Control task lateness (ms) above which display tasks yield to them
+#define TASK_LATENESS_MAX 10
 
 // ***** DISPLAY SPECIFIC CONSTANTS *****
-#define UPDATE_RATE 100
+#define UPDATE_RATE 100 // Display change polling period (ms)
+// Redraw at least this often (ms) even when nothing changed, and send the
+// whole frame so a page missed by change detection is not left stale, 0 to
+// disable
+#define DISPLAY_LATENCY_MAX 5000
+// Minimum time (ms) between redraws while baking, state changes excepted
+#define DISPLAY_BAKE_PERIOD 2000
+#define OLED_ASYNC_FLUSH 1 // Send frame buffer from TWI interrupt (OLED only)
+// Render the scene one 128 byte page at a time instead of into a 1 KB frame
+// buffer, at the cost of drawing it once per page (OLED only)
+#define OLED_PAGE_MODE 1
+
+// ***** PID NUMBER FORMAT *****
+#if PID_FIXED_POINT
+// Temperatures in 1/16 degree Celsius, output in ms of the SSR window
+typedef int32_t pidValue_t;
+// Gains in Q16.16, per degree Celsius and per second like PID_v1
+typedef int32_t pidGain_t;
+#define PID_VALUE_SHIFT 4
+#define PID_GAIN(k) ((pidGain_t)(((k) * 65536.0) + 0.5))
+#define TEMPERATURE(t) ((pidValue_t)(t) * (1 << PID_VALUE_SHIFT))
+#define TEMPERATURE_RAW(raw) ((pidValue_t)(raw) >> (7 - PID_VALUE_SHIFT))
+#define TEMPERATURE_Q4(t) ((int16_t)((t) >> (PID_VALUE_SHIFT - 4)))
+#define TEMPERATURE_FROM_Q4(q) ((pidValue_t)(q) << (PID_VALUE_SHIFT - 4))
+#else
+typedef double pidValue_t;
+typedef double pidGain_t;
+#define PID_GAIN(k) (k)
+#define TEMPERATURE(t) ((pidValue_t)(t))
+#define TEMPERATURE_RAW(raw) ((raw) / 128.0)
+#define TEMPERATURE_Q4(t) ((int16_t)((t) * 16))
+#define TEMPERATURE_FROM_Q4(q) ((q) / 16.0)
+#endif
 
 // ***** PID PARAMETERS *****
 // ***** PRE-HEAT STAGE *****
-#define PID_KP_PREHEAT 100
-#define PID_KI_PREHEAT 0.025
-#define PID_KD_PREHEAT 20
+constexpr pidGain_t PID_KP_PREHEAT = PID_GAIN(100);
+constexpr pidGain_t PID_KI_PREHEAT = PID_GAIN(0.025);
+constexpr pidGain_t PID_KD_PREHEAT = PID_GAIN(20);
 // ***** SOAKING STAGE *****
-#define PID_KP_SOAK 300
-#define PID_KI_SOAK 0.05
-#define PID_KD_SOAK 250
+constexpr pidGain_t PID_KP_SOAK = PID_GAIN(300);
+constexpr pidGain_t PID_KI_SOAK = PID_GAIN(0.05);
+constexpr pidGain_t PID_KD_SOAK = PID_GAIN(250);
 // ***** REFLOW STAGE *****
-#define PID_KP_REFLOW 300
-#define PID_KI_REFLOW 0.05
-#define PID_KD_REFLOW 350
+constexpr pidGain_t PID_KP_REFLOW = PID_GAIN(300);
+constexpr pidGain_t PID_KI_REFLOW = PID_GAIN(0.05);
+constexpr pidGain_t PID_KD_REFLOW = PID_GAIN(350);
 #define PID_SAMPLE_TIME 1000
 // ***** BAKE STAGE *****
-#define PID_KP_BAKE 100
-#define PID_KI_BAKE 0.07
-#define PID_KD_BAKE 20
+constexpr pidGain_t PID_KP_BAKE = PID_GAIN(100);
+constexpr pidGain_t PID_KI_BAKE = PID_GAIN(0.07);
+constexpr pidGain_t PID_KD_BAKE = PID_GAIN(20);
 
-#if VERSION == 2
-#define SCREEN_WIDTH 128 // OLED display width, in pixels
-#define SCREEN_HEIGHT 64 // OLED display height, in pixels
-#define X_AXIS_START 18 // X-axis starting position
+// ***** THERMAL MODEL CONSTANTS *****
+// First order plus dead time fit of the preheat ramp
+#define MODEL_RISE 2 // Rise (degree Celsius) ending the dead time
+#define MODEL_WINDOW 10 // Slope measurement window (PID samples)
+#define MODEL_DUTY_MIN 90 // Windows below this average duty (%) are ignored
+#define MODEL_SPAN_MIN 20 // Minimum span (degree Celsius) between fitted windows
+
+typedef struct PID_GAINS
+{
+  pidGain_t kp;
+  pidGain_t ki;
+  pidGain_t kd;
+} pidGains_t;
+
+// Indexed by pidGainSet_t
+const pidGains_t pidGains[] PROGMEM = {
+  { PID_KP_PREHEAT, PID_KI_PREHEAT, PID_KD_PREHEAT },
+  { PID_KP_SOAK, PID_KI_SOAK, PID_KD_SOAK },
+  { PID_KP_REFLOW, PID_KI_REFLOW, PID_KD_REFLOW },
+  { PID_KP_BAKE, PID_KI_BAKE, PID_KD_BAKE }
+};
+
+// ***** AUTO-TUNE CONSTANTS *****
+// Relay experiment around each tune point, Tyreus-Luyben rule on the result
+#define TUNE_HYSTERESIS 2 // Relay band (degree Celsius) on each side of the point
+#define TUNE_CYCLES 3 // Averaged oscillations, after a discarded first one
+#define TUNE_TIMEOUT 1800 // Per tune point (s)
+// Kp = Ku / 2.2 with Ku = 4 d / (pi a), a in 1/16 degree Celsius
+constexpr pidGain_t TUNE_KP = PID_GAIN(4 * 16 / (3.14159265 * 2.2));
+
+typedef struct TUNE_POINT
+{
+  int16_t temperature;
+  pidGainSet_t gains;
+} __attribute__((packed)) tunePoint_t;
+
+// Ascending, each point is reached by heating from the previous one
+const tunePoint_t tunePoints[] PROGMEM = {
+  { TEMPERATURE_BAKE, PID_GAINS_BAKE },
+  { TEMPERATURE_SOAK_MIN, PID_GAINS_PREHEAT },
+  { TEMPERATURE_SOAK_MAX_PB, PID_GAINS_SOAK },
+  { TEMPERATURE_REFLOW_MAX_PB, PID_GAINS_REFLOW }
+};
+#define TUNE_POINT_COUNT ((unsigned char)(sizeof(tunePoints) / sizeof(tunePoints[0])))
+
+// ***** REFLOW PROFILES *****
+// Segments run in order, the profile completes after its last segment
+const reflowSegment_t reflowSegments[] PROGMEM = {
+  // Lead-free
+  { REFLOW_STATE_PREHEAT, PID_GAINS_PREHEAT, SEGMENT_EXIT_ABOVE, TEMPERATURE_SOAK_MIN, 0 },
+  { REFLOW_STATE_SOAK, PID_GAINS_SOAK, SEGMENT_EXIT_RAMP, TEMPERATURE_SOAK_MAX_LF, SOAK_RAMP_RATE_LF },
+  { REFLOW_STATE_REFLOW, PID_GAINS_REFLOW, SEGMENT_EXIT_ABOVE, TEMPERATURE_REFLOW_MAX_LF, TEMPERATURE_REFLOW_MARGIN },
+  { REFLOW_STATE_COOL, PID_GAINS_REFLOW, SEGMENT_EXIT_BELOW, TEMPERATURE_COOL_MIN, 0 },
+  // Leaded
+  { REFLOW_STATE_PREHEAT, PID_GAINS_PREHEAT, SEGMENT_EXIT_ABOVE, TEMPERATURE_SOAK_MIN, 0 },
+  { REFLOW_STATE_SOAK, PID_GAINS_SOAK, SEGMENT_EXIT_RAMP, TEMPERATURE_SOAK_MAX_PB, SOAK_RAMP_RATE_PB },
+  { REFLOW_STATE_REFLOW, PID_GAINS_REFLOW, SEGMENT_EXIT_ABOVE, TEMPERATURE_REFLOW_MAX_PB, TEMPERATURE_REFLOW_MARGIN },
+  { REFLOW_STATE_COOL, PID_GAINS_REFLOW, SEGMENT_EXIT_BELOW, TEMPERATURE_COOL_MIN, 0 },
+  // Bake
+  { REFLOW_STATE_BAKE, PID_GAINS_BAKE, SEGMENT_EXIT_NEVER, TEMPERATURE_BAKE, 0 }
+};
+
+// Indexed by reflowProfile_t
+const reflowProfileEntry_t reflowProfiles[REFLOW_PROFILE_COUNT] PROGMEM = {
+  { "LF", 0, 4 },
+  { "PB", 4, 4 },
+  { "BK", 8, 1 },
+  { "CU", 0, 0 }
+};
+
+// ***** SETTINGS STORE CONSTANTS *****
+#define SETTINGS_VERSION 1
+// Records rotate through fixed size slots covering the whole EEPROM
+#define SETTINGS_SLOT_SIZE 128
+#define SETTINGS_SLOTS ((E2END + 1) / SETTINGS_SLOT_SIZE)
+// Changes are written once settled for this long (ms) with the oven off
+#define SETTINGS_WRITE_DELAY 5000
+#define CUSTOM_SEGMENT_MAX 6
+
+typedef struct SETTINGS
+{
+  // Incremented with every record, the newest valid record wins
+  uint16_t sequence;
+  uint8_t version;
+  reflowProfile_t profile;
+  // Indexed by pidGainSet_t
+  pidGains_t gains[PID_GAINS_COUNT];
+  uint8_t segmentCount;
+  reflowSegment_t segments[CUSTOM_SEGMENT_MAX];
+} __attribute__((packed)) settings_t;
+
+// Record is followed by its CRC within the slot
+static_assert(sizeof(settings_t) + sizeof(uint16_t) <= SETTINGS_SLOT_SIZE,
+              "Settings record does not fit in a slot");
+
+// ***** BOARD TRAITS *****
+// Everything that differs between the boards. Code templated on the board
+// tests these with if constexpr, the branch of the other board is discarded
+// at compile time along with the library names it depends on.
+
+// Display backends, defined with the display task
+template <typename B> class LcdDisplay;
+template <typename B> class OledDisplay;
+// Panel library classes, only the library of the selected board is included
+class LiquidCrystal;
+class Adafruit_SSD1306_SB;
+
+typedef enum SWITCH_DECODER : uint8_t
+{
+  SWITCH_DECODER_LADDER, // Resistor ladder on a single ADC pin
+  SWITCH_DECODER_DIGITAL // One pin per switch, active low
+} switchDecoder_t;
+
+// ATtiny1634R with 8x2 LCD
+struct BoardV1
+{
+  // HD44780 alphanumeric LCD
+  typedef LiquidCrystal Panel;
+  typedef LcdDisplay<BoardV1> Display;
+  static constexpr switchDecoder_t switchDecoder = SWITCH_DECODER_LADDER;
+  static constexpr bool hasFan = false;
+  // No SRAM to spare for a flash page buffer
+  static constexpr bool hasRunLog = false;
+  static constexpr bool hasFaultPin = false;
+  // Switches and FAULT pin on a shared pin change interrupt
+  static constexpr bool hasPinChange = false;
+  static constexpr unsigned char ssrPin = 3;
+  static constexpr unsigned char thermocoupleCSPin = 2;
+  static constexpr unsigned char lcdRsPin = 10;
+  static constexpr unsigned char lcdEPin = 9;
+  static constexpr unsigned char lcdD4Pin = 8;
+  static constexpr unsigned char lcdD5Pin = 7;
+  static constexpr unsigned char lcdD6Pin = 6;
+  static constexpr unsigned char lcdD7Pin = 5;
+  static constexpr unsigned char buzzerPin = 14;
+  static constexpr unsigned char switchPin = A1;
+  static constexpr unsigned char ledPin = LED_BUILTIN;
+  // Not routed on the PCB, patch wire MAX31856 DRDY to a spare pin
+  static constexpr unsigned char thermocoupleDrdyPin = 4;
+  static constexpr unsigned char screenWidth = 8; // In characters
+  static constexpr unsigned char screenHeight = 2; // In characters
+  static constexpr bool hasPlot = false;
+  static constexpr unsigned char plotColumns = 0;
+};
+
+// ATMega328P with 128x64 OLED
+struct BoardV2
+{
+  // SSD1306 graphic OLED on TWI
+  typedef Adafruit_SSD1306_SB Panel;
+  typedef OledDisplay<BoardV2> Display;
+  static constexpr switchDecoder_t switchDecoder = SWITCH_DECODER_DIGITAL;
+  static constexpr bool hasFan = true;
+  static constexpr bool hasRunLog = true;
+  static constexpr bool hasFaultPin = true;
+  static constexpr bool hasPinChange = true;
+  static constexpr unsigned char ssrPin = A0;
+  static constexpr unsigned char fanPin = A1;
+  static constexpr unsigned char thermocoupleCSPin = 10;
+  static constexpr unsigned char ledPin = 4;
+  static constexpr unsigned char buzzerPin = 5;
+  static constexpr unsigned char switchStartStopPin = 3;
+  static constexpr unsigned char switchLfPbPin = 2;
+  // Not routed on the PCB, patch wire MAX31856 DRDY to a spare pin
+  static constexpr unsigned char thermocoupleDrdyPin = 9;
+  // Not routed on the PCB, patch wire MAX31856 FAULT to a spare pin
+  static constexpr unsigned char thermocoupleFaultPin = 7;
+  // Spare pin, SPI NOR flash of the run log
+  static constexpr unsigned char flashCSPin = 8;
+  static constexpr unsigned char screenWidth = 128; // In pixels
+  static constexpr unsigned char screenHeight = 64; // In pixels
+  static constexpr bool hasPlot = true;
+  static constexpr unsigned char xAxisStart = 18; // X-axis starting position
+  static constexpr unsigned char plotColumns = screenWidth - xAxisStart; // Even for 2:1 merging
+};
+
+#if VERSION == 1
+typedef BoardV1 Board;
+#elif VERSION == 2
+typedef BoardV2 Board;
+#endif
+
+static_assert((Board::plotColumns % 2) == 0, "Plot columns merge 2:1");
+static_assert(!RUN_LOG || Board::hasRunLog, "Run log is not available on this board");
+static_assert(!SENSOR_FAULT_INTERRUPT || Board::hasFaultPin, "FAULT pin is not available on this board");
+
+#define SCREEN_WIDTH (Board::screenWidth)
+#define SCREEN_HEIGHT (Board::screenHeight)
+#define OLED_PAGES ((SCREEN_HEIGHT + 7) / 8) // 8 pixel rows per page
+#define OLED_SEGMENTS 4 // Change detection granularity within a page
+#define OLED_SEGMENT_WIDTH (SCREEN_WIDTH / OLED_SEGMENTS)
+// Switch and thermocouple FAULT pin changes, all on port D of the ATmega328P
+#define PIN_CHANGE_vect PCINT2_vect
+#define PIN_CHANGE_PORT 2 // digitalPinToPCICRbit() of those pins
+// Pin change flags are held by GIFR on the ATtiny1634
+#if defined(PCIFR)
+#define PIN_CHANGE_FLAGS PCIFR
+#else
+#define PIN_CHANGE_FLAGS GIFR
 #endif
+// At least one column so the plot code compiles on boards without a plot
+#define PLOT_COLUMNS (Board::hasPlot ? Board::plotColumns : 2)
+#define PLOT_TOP 19 // Row of 250 degree Celsius
+#define PLOT_BOTTOM 63 // Row of 0 degree Celsius
+#define PLOT_PERIOD 1000 // Time (ms) covered by a column until the first merge
 
 // ***** LCD MESSAGES *****
 const char lcdMessagesReflowStatus_1[] PROGMEM = "Ready";
@@ -245,6 +831,38 @@ const char lcdMessagesReflowStatus_6[] PROGMEM = "Done!";
 const char lcdMessagesReflowStatus_7[] PROGMEM = "Hot!";
 const char lcdMessagesReflowStatus_8[] PROGMEM = "Error";
 const char lcdMessagesReflowStatus_9[] PROGMEM = "Bake";
+const char lcdMessagesReflowStatus_10[] PROGMEM = "Tune";
+const char lcdMessagesReflowStatus_11[] PROGMEM = "Next";
+
+#if BENCHMARK
+// ***** BENCHMARK PATH NAMES *****
+const char benchName_1[] PROGMEM = "PID";
+const char benchName_2[] PROGMEM = "Sensor";
+const char benchName_3[] PROGMEM = "Format";
+const char benchName_4[] PROGMEM = "Telemetry";
+const char benchName_5[] PROGMEM = "Render";
+const char benchName_6[] PROGMEM = "Display";
+const char benchName_7[] PROGMEM = "Loop";
+#endif
+
+#if PROFILING
+// ***** PROFILE SECTION NAMES *****
+const char profileSectionName_1[] PROGMEM = "Loop";
+const char profileSectionName_2[] PROGMEM = "Sensor";
+const char profileSectionName_3[] PROGMEM = "PID";
+const char profileSectionName_4[] PROGMEM = "Reflow";
+const char profileSectionName_5[] PROGMEM = "Render";
+const char profileSectionName_6[] PROGMEM = "Flush";
+
+const char* const profileSectionName[] PROGMEM = {
+  profileSectionName_1,
+  profileSectionName_2,
+  profileSectionName_3,
+  profileSectionName_4,
+  profileSectionName_5,
+  profileSectionName_6
+};
+#endif
 
 const char* const lcdMessagesReflowStatus[] PROGMEM = {
   lcdMessagesReflowStatus_1,
@@ -255,552 +873,1151 @@ const char* const lcdMessagesReflowStatus[] PROGMEM = {
   lcdMessagesReflowStatus_6,
   lcdMessagesReflowStatus_7,
   lcdMessagesReflowStatus_8,
-  lcdMessagesReflowStatus_9
+  lcdMessagesReflowStatus_9,
+  lcdMessagesReflowStatus_10,
+  lcdMessagesReflowStatus_11
 };
 
-#if VERSION == 1
+// Tables of the display backend not built are dropped by the linker
 // ***** DEGREE SYMBOL FOR LCD *****
 static const unsigned char degree[8] = {
   140, 146, 146, 140, 128, 128, 128, 128
 };
-#endif
+
+// ***** OLED STATIC LAYER *****
+// Temperature labels, axes and ticks pre-rendered with the 5x7 font, copied
+// in before the dynamic elements. Each page row holds CHROME_WIDTH columns
+// followed by a fill byte repeated up to the right edge (bottom axis).
+#define CHROME_FIRST_PAGE 2
+#define CHROME_PAGES 6
+#define CHROME_WIDTH 21 // Up to the Y-axis and its ticks (xAxisStart + 3)
+const uint8_t displayChrome[CHROME_PAGES * (CHROME_WIDTH + 1)] PROGMEM = {
+  0x90, 0x48, 0x48, 0x48, 0x30, 0x00, 0x38, 0x28, 0x28, 0x28, 0xC8, 0x00, 0xF0, 0x88, 0x48, 0x28, 0xF0, 0x00, 0xFC, 0x08, 0x08, 0x00,
+  0x03, 0x02, 0x02, 0x02, 0x02, 0x00, 0x01, 0x02, 0x02, 0x02, 0x01, 0x00, 0x01, 0x02, 0x02, 0x02, 0x01, 0x00, 0xFF, 0x00, 0x00, 0x00,
+  0x00, 0x20, 0xF0, 0x00, 0x00, 0x00, 0x70, 0x50, 0x50, 0x50, 0x90, 0x00, 0xE0, 0x10, 0x90, 0x50, 0xE0, 0x00, 0xFF, 0x10, 0x10, 0x00,
+  0x00, 0x04, 0x07, 0x04, 0x00, 0x00, 0x02, 0x04, 0x04, 0x04, 0x03, 0x00, 0x03, 0x05, 0x04, 0x04, 0x03, 0x00, 0xFF, 0x00, 0x00, 0x00,
+  0xC0, 0x40, 0x40, 0x40, 0x40, 0x00, 0x80, 0x40, 0x40, 0x40, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x40, 0x40, 0x00,
+  0x09, 0x11, 0x11, 0x11, 0x0E, 0x00, 0x0F, 0x14, 0x12, 0x11, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x80, 0x80, 0x80
+};
+
+// ***** OLED TEMPERATURE GLYPHS *****
+// 5x7 font columns plus spacing, written straight into a buffer page
+#define GLYPH_WIDTH 6
+#define GLYPH_POINT 10
+#define GLYPH_MINUS 11
+#define GLYPH_DEGREE 12
+#define GLYPH_CELSIUS 13
+const uint8_t temperatureGlyphs[][GLYPH_WIDTH] PROGMEM = {
+  { 0x3E, 0x51, 0x49, 0x45, 0x3E, 0x00 }, // 0
+  { 0x00, 0x42, 0x7F, 0x40, 0x00, 0x00 }, // 1
+  { 0x72, 0x49, 0x49, 0x49, 0x46, 0x00 }, // 2
+  { 0x21, 0x41, 0x49, 0x4D, 0x33, 0x00 }, // 3
+  { 0x18, 0x14, 0x12, 0x7F, 0x10, 0x00 }, // 4
+  { 0x27, 0x45, 0x45, 0x45, 0x39, 0x00 }, // 5
+  { 0x3C, 0x4A, 0x49, 0x49, 0x31, 0x00 }, // 6
+  { 0x41, 0x21, 0x11, 0x09, 0x07, 0x00 }, // 7
+  { 0x36, 0x49, 0x49, 0x49, 0x36, 0x00 }, // 8
+  { 0x46, 0x49, 0x49, 0x29, 0x1E, 0x00 }, // 9
+  { 0x00, 0x60, 0x60, 0x00, 0x00, 0x00 }, // .
+  { 0x08, 0x08, 0x08, 0x08, 0x08, 0x00 }, // -
+  { 0x00, 0x06, 0x09, 0x09, 0x06, 0x00 }, // degree
+  { 0x3E, 0x41, 0x41, 0x41, 0x22, 0x00 }  // C
+};
+// Temperature reading, right aligned on page 1
+#define TEMPERATURE_PAGE 1
+#define TEMPERATURE_RIGHT 122
 
 // ***** PIN ASSIGNMENT *****
-#if VERSION == 1
-static const unsigned char ssrPin = 3;
-static const unsigned char thermocoupleCSPin = 2;
-static const unsigned char lcdRsPin = 10;
-static const unsigned char lcdEPin = 9;
-static const unsigned char lcdD4Pin = 8;
-static const unsigned char lcdD5Pin = 7;
-static const unsigned char lcdD6Pin = 6;
-static const unsigned char lcdD7Pin = 5;
-static const unsigned char buzzerPin = 14;
-static const unsigned char switchPin = A1;
-static const unsigned char ledPin = LED_BUILTIN;
-#elif VERSION == 2
-static const unsigned char ssrPin = A0;
-static const unsigned char fanPin = A1;
-static const unsigned char thermocoupleCSPin = 10;
-static const unsigned char ledPin = 4;
-static const unsigned char buzzerPin = 5;
-static const unsigned char switchStartStopPin = 3;
-static const unsigned char switchLfPbPin = 2;
-#endif
+// Pins common to all boards, the others are read from Board directly
+static const unsigned char ssrPin = Board::ssrPin;
+static const unsigned char thermocoupleCSPin = Board::thermocoupleCSPin;
+static const unsigned char ledPin = Board::ledPin;
+static const unsigned char buzzerPin = Board::buzzerPin;
+static const unsigned char thermocoupleDrdyPin = Board::thermocoupleDrdyPin;
+// One chip select per channel, extra probes need spare pins
+static const unsigned char thermocoupleCSPins[] = { thermocoupleCSPin };
+
+// ***** SENSOR CHANNELS *****
+// Share of each channel in SENSOR_INPUT_AVERAGE, 0 to leave it out
+const uint8_t sensorWeights[] PROGMEM = { 1 };
+
+static_assert(sizeof(thermocoupleCSPins) == SENSOR_CHANNELS, "One chip select per channel");
+static_assert(sizeof(sensorWeights) == SENSOR_CHANNELS, "One weight per channel");
+static_assert(SENSOR_INPUT_INDEX < SENSOR_CHANNELS, "Input channel out of range");
+static_assert(!SENSOR_DRDY || (SENSOR_CHANNELS == 1), "DRDY is wired for a single channel");
 
 // ***** PID CONTROL VARIABLES *****
-double setpoint;
-double input;
-double output;
-double kp = PID_KP_PREHEAT;
-double ki = PID_KI_PREHEAT;
-double kd = PID_KD_PREHEAT;
+pidValue_t setpoint;
+// Filtered temperature seen by the PID
+pidValue_t input;
+// Latest unfiltered sample, for telemetry
+pidValue_t inputRaw;
+pidValue_t output;
+pidGain_t kp = PID_KP_PREHEAT;
+pidGain_t ki = PID_KI_PREHEAT;
+pidGain_t kd = PID_KD_PREHEAT;
 unsigned int windowSize;
-unsigned long windowStartTime;
-unsigned long nextCheck;
-unsigned long nextRead;
-unsigned long updateLcd;
-unsigned long timerSoak;
+#if SENSOR_MEDIAN || SENSOR_IIR_SHIFT
+// Filter state, restarted from the next sample after a fault
+bool sensorPrimed;
+#endif
+#if SENSOR_MEDIAN
+int32_t sensorHistory[SENSOR_MEDIAN];
+unsigned char sensorHistoryIndex;
+#endif
+#if SENSOR_IIR_SHIFT
+int32_t sensorAccumulator;
+#endif
+// Latest sample of each channel (LSB = 1/128 degree Celsius) and its fault
+// status, the control input is derived once all of them have been read
+int32_t sensorTemperature[SENSOR_CHANNELS];
+uint8_t sensorFault[SENSOR_CHANNELS];
+unsigned char sensorChannel;
+sensorInput_t sensorInput = SENSOR_INPUT;
+unsigned char sensorInputChannel = SENSOR_INPUT_INDEX;
+#if THERMAL_MODEL
+// dT/dt = gain * duty - loss * (T - ambient), per MODEL_WINDOW seconds with
+// temperatures in 1/16 degree Celsius, fitted once per run
+modelPhase_t modelPhase;
+int16_t modelAmbient;
+unsigned int modelLag; // Dead time (s)
+int32_t modelLoss; // Q16
+int32_t modelGain; // At full duty
+// Measured heating rate, 1/256 degree Celsius per second
+int32_t modelSlope;
+int16_t modelLast;
+// Fit windows
+unsigned char modelSamples;
+uint32_t modelDutySum;
+int16_t modelWindowStart;
+unsigned char modelWindows;
+int32_t modelSlopeFirst;
+int16_t modelTemperatureFirst;
+int32_t modelSlopeLast;
+int16_t modelTemperatureLast;
+#endif
+// Relay auto-tune of the active tune point
+tunePoint_t tunePoint;
+unsigned char tuneIndex;
+bool tuneHeating;
+unsigned char tuneEdges; // Heating edges seen at this point
+unsigned long tuneCycleStart;
+unsigned long tuneTimeout;
+unsigned long tuneSampleTime;
+int16_t tuneMax;
+int16_t tuneMin;
+uint32_t tunePeriodSum; // ms
+uint16_t tuneSwingSum; // Peak to peak, 1/16 degree Celsius
+// Queued profile runs, the head starts from REARM once confirmed
+reflowProfile_t batchQueue[BATCH_QUEUE_SIZE];
+unsigned char batchCount;
+bool batchActive;
+bool batchConfirmed;
+// Completed runs and their accumulated run and wait times (s)
+unsigned int batchRuns;
+unsigned long batchRunTime;
+unsigned long batchWaitTime;
+unsigned int batchLastWait;
+// Start (ms) of the current run or wait
+unsigned long batchMark;
+// Scheduler pass time
+unsigned long currentTime;
 unsigned long buzzerPeriod;
-unsigned char soakTemperatureMax;
-unsigned char reflowTemperatureMax;
-unsigned long soakMicroPeriod;
+// Active segment of the running profile, copied from flash
+reflowSegment_t segment;
+unsigned char segmentIndex;
+unsigned char segmentEnd;
+// Ramp step or hold end time
+unsigned long timerSegment;
+// Ramp progress short of a whole 1/16 degree step, 1/3600 of a step
+int32_t segmentRemainder;
 // Reflow oven controller state machine state variable
 reflowState_t reflowState;
 // Reflow oven controller status
 reflowStatus_t reflowStatus;
 // Reflow profile type
 reflowProfile_t reflowProfile;
+// Persistent settings, mirrored in EEPROM by settingsTask
+settings_t settings;
+// Slot holding the newest record
+unsigned char settingsSlot;
+// Pending change and time of the last one
+bool settingsDirty;
+unsigned long settingsChangeTime;
+// Record write in progress, byte offset within the slot
+bool settingsWriting;
+unsigned char settingsOffset;
+uint16_t settingsCrc;
+// Last drawn values and time
+displaySnapshot_t displayShown;
+unsigned long displayTime;
+// Last frame sent whole
+unsigned long displayRefreshTime;
 // Switch debounce state machine state variable
 debounceState_t debounceState;
-// Switch debounce timer
-long lastDebounceTime;
+// Switch debounce timer, time of the latest change
+unsigned long lastDebounceTime;
 // Switch press status
 switch_t switchStatus;
-switch_t switchValue;
 switch_t switchMask;
+// Switch level and time of its latest change, from the pin change ISR
+volatile switch_t switchLevel;
+volatile bool switchEdge;
+volatile unsigned long switchEdgeTime;
 // Seconds timer
 unsigned int timerSeconds;
-// Thermocouple fault status
+// Fault status of the control input, per channel status in sensorFault
 unsigned char fault;
-
-#if VERSION == 2
-unsigned int timerUpdate;
-unsigned char temperature[SCREEN_WIDTH - X_AXIS_START];
-unsigned char xHead=0;
-unsigned char xCnt=0;
-unsigned char xScrollOffset=0;
+#if SENSOR_FAULT_INTERRUPT
+// FAULT pin asserted, the SSR is held off until the main loop has looked
+volatile bool sensorTrip;
+// MASK register of each channel, only faults that stop the process assert
+// the shared FAULT pin so that it is free to fall again for the next one
+uint8_t sensorFaultOutput[SENSOR_CHANNELS];
 #endif
+// Telemetry format and binary frame sequence number
+telemetryMode_t telemetryMode = TELEMETRY_MODE;
+unsigned char telemetrySequence;
+// Telemetry record every N PID samples
+unsigned char telemetryDecimation = TELEMETRY_DECIMATION;
+unsigned char telemetryDecimationCount;
+// Serial command line being received
+char commandBuffer[COMMAND_BUFFER_SIZE];
+unsigned char commandLength;
+bool commandOverflow;
+// SSR on time within window (ms), owned by the PID and read from Timer1 ISR
+volatile unsigned int ssrDuty;
+// SSR window position (ms), owned by the Timer1 ISR
+volatile unsigned int ssrWindowCounter;
+#if SSR_BURST_FIRE
+// SSR on time accumulated over half-cycles
+unsigned int ssrAccumulator;
+#endif
+// Fan on time within its window (ms), same ownership as the SSR
+volatile unsigned int fanDuty;
+unsigned int fanWindowCounter;
+// Cool-down rate scaled by 2^FAN_RATE_SHIFT (1/16 degree Celsius per sample)
+// and PI integral (Q.8 of duty %)
+int16_t fanLast;
+int16_t fanRateAccumulator;
+int32_t fanIntegral;
 
-// PID control interface
-PID reflowOvenPID(&input, &output, &setpoint, kp, ki, kd, DIRECT);
-#if VERSION == 1
-// LCD interface
-LiquidCrystal lcd(lcdRsPin, lcdEPin, lcdD4Pin, lcdD5Pin, lcdD6Pin, lcdD7Pin);
-#elif VERSION == 2
-uint8_t SSD1306_SFB[SCREEN_WIDTH * ((SCREEN_HEIGHT + 7) / 8)];
-class Adafruit_SSD1306_SB : public Adafruit_SSD1306
+// Plot history, each column holds the row span of the samples it covers.
+// Unreferenced, and dropped by the linker, on boards without a plot.
+unsigned char plotTop[PLOT_COLUMNS];
+unsigned char plotBottom[PLOT_COLUMNS];
+unsigned char plotCount;
+// Columns cover PLOT_PERIOD times plotSpan, doubled with every merge
+unsigned int plotSpan = 1;
+unsigned long plotColumnEnd;
+
+#if PID_FIXED_POINT
+// ***** FIXED-POINT PID CONTROLLER *****
+// Same interface and algorithm (proportional on error) as PID_v1 but on
+// scaled integers, keeping soft-float out of the control loop. Internally
+// gains are rescaled per input unit and per sample period, saturated to 15
+// bits so that every product fits 32 bits (Kp & Kd < 2048, Ki < 8 at 1 s).
+#define AUTOMATIC 1
+#define MANUAL 0
+#define DIRECT 0
+#define REVERSE 1
+
+// value * multiplier / divisor without the 64-bit routines of libgcc, one
+// shift and subtract step per multiplier bit. Truncated unless rounded,
+// saturates at 0xFFFFFFFF, only used when gains change.
+uint32_t mulDiv(uint32_t value, uint32_t multiplier, uint32_t divisor, bool rounded = false)
 {
-public:
-  Adafruit_SSD1306_SB(uint8_t w, uint8_t h, TwoWire* twi = &Wire,
-    int8_t rst_pin = -1, uint32_t clkDuring = 400000UL,
-    uint32_t clkAfter = 100000UL) : Adafruit_SSD1306(w, h, twi, rst_pin, clkDuring, clkAfter)
-  {
-    buffer = SSD1306_SFB;
+  uint32_t valueQuotient = value / divisor;
+  uint32_t valueRemainder = value % divisor;
+  uint32_t quotient = 0;
+  // Always below divisor, compared against (divisor - x) to never overflow
+  uint32_t remainder = 0;
 
-  }
-  ~Adafruit_SSD1306_SB(void)
+  for (uint32_t bit = 0x80000000UL; bit != 0; bit >>= 1)
   {
-    buffer = NULL;
-  }
-};
+    if (quotient > 0x7FFFFFFFUL) return 0xFFFFFFFFUL;
+    quotient <<= 1;
+    if (remainder >= divisor - remainder)
+    {
+      remainder -= divisor - remainder;
+      quotient++;
+    }
+    else
+    {
+      remainder <<= 1;
+    }
+    if (!(multiplier & bit)) continue;
 
-Adafruit_SSD1306_SB oled(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire);
-#endif
-// MAX31856 thermocouple interface
-Adafruit_MAX31856 thermocouple = Adafruit_MAX31856(thermocoupleCSPin);
+    if (quotient > 0xFFFFFFFFUL - valueQuotient - 1) return 0xFFFFFFFFUL;
+    quotient += valueQuotient;
+    if (remainder >= divisor - valueRemainder)
+    {
+      remainder -= divisor - valueRemainder;
+      quotient++;
+    }
+    else
+    {
+      remainder += valueRemainder;
+    }
+  }
+  // Round half up
+  if (rounded && (remainder >= divisor - remainder) && (quotient != 0xFFFFFFFFUL)) quotient++;
 
-switch_t readSwitch(void);
+  return quotient;
+}
 
-void setup()
+class FixedPID
 {
-  // Check current selected reflow profile
-  unsigned char value = EEPROM.read(PROFILE_TYPE_ADDRESS);
-  if ((value == 0) || (value == 1) || (value == 2))
+public:
+  FixedPID(pidValue_t *input, pidValue_t *output, pidValue_t *setpoint,
+           pidGain_t kp, pidGain_t ki, pidGain_t kd, uint8_t direction)
   {
-    // Valid reflow profile value
-    reflowProfile = static_cast<reflowProfile_t>(value);
+    myInput = input;
+    myOutput = output;
+    mySetpoint = setpoint;
+    inAuto = false;
+    controllerDirection = direction;
+    SetOutputLimits(0, 255);
+    sampleTime = 100;
+    SetTunings(kp, ki, kd);
+    lastTime = millis() - sampleTime;
   }
-  else
+
+  bool Compute(void)
   {
-    // Default to lead-free profile
-    EEPROM.write(PROFILE_TYPE_ADDRESS, 0);
-    reflowProfile = REFLOW_PROFILE_LEADFREE;
-  }
+    unsigned long now;
+    pidValue_t error;
+    pidValue_t dInput;
+    int32_t result;
 
-  // SSR pin initialization to ensure reflow oven is off
-  digitalWrite(ssrPin, LOW);
-  pinMode(ssrPin, OUTPUT);
+    if (!inAuto) return false;
+    now = millis();
+    if ((now - lastTime) < sampleTime) return false;
 
-  // Buzzer pin initialization to ensure annoying buzzer is off
-  digitalWrite(buzzerPin, LOW);
-  pinMode(buzzerPin, OUTPUT);
+    error = *mySetpoint - *myInput;
+    dInput = *myInput - lastInput;
 
-  // LED pins initialization and turn on upon start-up (active high)
-  pinMode(ledPin, OUTPUT);
-  digitalWrite(ledPin, HIGH);
+    // Integral term accumulated in Q.16 of the output for resolution
+    outputSum += kiScaled * error;
+    if (outputSum > (outMax << 16)) outputSum = outMax << 16;
+    else if (outputSum < (outMin << 16)) outputSum = outMin << 16;
 
-  // Initialize thermocouple interface
-  thermocouple.begin();
-  thermocouple.setThermocoupleType(MAX31856_TCTYPE_K);
+    // Proportional and derivative terms in Q.8 of the output
+    result = (kpScaled * error) - (kdScaled * dInput) + (outputSum >> 8);
+    result = (result + 128) >> 8;
+    if (result > outMax) result = outMax;
+    else if (result < outMin) result = outMin;
+    *myOutput = result;
 
-  // Start-up splash
-  digitalWrite(buzzerPin, HIGH);
-#if VERSION == 1
-  lcd.begin(8, 2);
-  lcd.createChar(0, degree);
-  lcd.clear();
-  lcd.print(F(" Tiny  "));
-  lcd.setCursor(0, 1);
-  lcd.print(F(" Reflow "));
-#elif VERSION == 2
-  oled.begin(SSD1306_SWITCHCAPVCC, 0x3C);
-  oled.display();
-#endif
-  digitalWrite(buzzerPin, LOW);
-  delay(1000);
-#if VERSION == 1
-  lcd.clear();
-  lcd.print(F(" v1.00  "));
-  lcd.setCursor(0, 1);
-  lcd.print(F("26-07-17"));
-  delay(2000);
-  lcd.clear();
-#elif VERSION == 2
-  oled.clearDisplay();
-  oled.setTextSize(1);
-  oled.setTextColor(WHITE);
-  oled.setCursor(0, 0);
-  oled.println(F("     Tiny Reflow"));
-  oled.println(F("     Controller"));
-  oled.println();
-  oled.println(F("       v2.10"));
-  oled.println();
-  oled.println(F("      01-05-20"));
-  oled.display();
-  delay(2000);
-  oled.clearDisplay();
-#endif
+    lastInput = *myInput;
+    lastTime = now;
+    return true;
+  }
 
-  // Serial communication at 115200 bps
-  Serial.begin(115200);
+  void SetTunings(pidGain_t kp, pidGain_t ki, pidGain_t kd)
+  {
+    if ((kp < 0) || (ki < 0) || (kd < 0)) return;
 
-  // Turn off LED (active high)
-  digitalWrite(ledPin, LOW);
-  // Set window size
-  windowSize = 2000;
-  // Initialize time keeping variable
-  nextCheck = millis();
-  // Initialize thermocouple reading variable
-  nextRead = millis();
-  // Initialize LCD update timer
-  updateLcd = millis();
-}
+    dispKp = kp;
+    dispKi = ki;
+    dispKd = kd;
+    scaleTunings();
+  }
 
-void loop()
-{
-  // Current time
-  unsigned long now;
-
-  // Time to read thermocouple?
-  if (millis() > nextRead)
-  {
-    // Read thermocouple next sampling period
-    nextRead += SENSOR_SAMPLING_TIME;
-    // Read current temperature
-    input = thermocouple.readThermocoupleTemperature();
-    // Check for thermocouple fault
-    fault = thermocouple.readFault();
-
-    // If any thermocouple fault is detected
-    if ((fault & MAX31856_FAULT_CJRANGE) ||
-        (fault & MAX31856_FAULT_TCRANGE) ||
-        (fault & MAX31856_FAULT_CJHIGH) ||
-        (fault & MAX31856_FAULT_CJLOW) ||
-        (fault & MAX31856_FAULT_TCHIGH) ||
-        (fault & MAX31856_FAULT_TCLOW) ||
-        (fault & MAX31856_FAULT_OVUV) ||
-        (fault & MAX31856_FAULT_OPEN))
-    {
-      // Illegal operation
-      reflowState = REFLOW_STATE_ERROR;
-      reflowStatus = REFLOW_STATUS_OFF;
-      Serial.println(F("Error"));
-    }
+  void SetSampleTime(int newSampleTime)
+  {
+    if (newSampleTime <= 0) return;
+
+    sampleTime = newSampleTime;
+    scaleTunings();
   }
 
-  if (millis() > nextCheck)
+  void SetOutputLimits(pidValue_t min, pidValue_t max)
   {
-    // Check input in the next seconds
-    nextCheck += SENSOR_SAMPLING_TIME;
-    // If reflow process is on going
-    if (reflowStatus == REFLOW_STATUS_ON)
-    {
-      // Toggle red LED as system heart beat
-      digitalWrite(ledPin, !(digitalRead(ledPin)));
-      // Increase seconds timer for reflow curve plot
-      timerSeconds++;
-      // Send temperature and time stamp to serial
-      Serial.print(timerSeconds);
-      Serial.print(F(","));
-      Serial.print(setpoint);
-      Serial.print(F(","));
-      Serial.print(input);
-      Serial.print(F(","));
-      Serial.println(output);
-    }
-    else
+    if (min >= max) return;
+
+    outMin = min;
+    outMax = max;
+    if (inAuto)
     {
-      // Turn off red LED
-      digitalWrite(ledPin, LOW);
+      if (*myOutput > outMax) *myOutput = outMax;
+      else if (*myOutput < outMin) *myOutput = outMin;
+      if (outputSum > (outMax << 16)) outputSum = outMax << 16;
+      else if (outputSum < (outMin << 16)) outputSum = outMin << 16;
     }
   }
 
-  if (millis() > updateLcd)
+  void SetMode(uint8_t mode)
   {
-    char txtBuffer[8];
-    strcpy_P(txtBuffer, (char *)pgm_read_word(&(lcdMessagesReflowStatus[reflowState])));
-    // Update LCD in the next 100 ms
-    updateLcd += UPDATE_RATE;
-#if VERSION == 1
-    // Clear LCD
-    lcd.clear();
-    // Print current system state
-    lcd.print(txtBuffer);
-    lcd.setCursor(6, 0);
-    if (reflowProfile == REFLOW_PROFILE_LEADFREE)
-    {
-      lcd.print(F("LF"));
-    }
-    else if (reflowProfile == REFLOW_PROFILE_LEADED)
-    {
-      lcd.print(F("PB"));
-    }
-    else
+    bool newAuto = (mode == AUTOMATIC);
+
+    // Bumpless transfer from manual to automatic
+    if (newAuto && !inAuto)
     {
-      lcd.print(F("BK"));
+      outputSum = *myOutput << 16;
+      lastInput = *myInput;
+      if (outputSum > (outMax << 16)) outputSum = outMax << 16;
+      else if (outputSum < (outMin << 16)) outputSum = outMin << 16;
     }
-    lcd.setCursor(0, 1);
-    
-    // If currently in error state
-    if (reflowState == REFLOW_STATE_ERROR)
+    inAuto = newAuto;
+  }
+
+private:
+  // Round (gain * multiplier / divisor) and saturate to 15 bits
+  static int32_t scaleGain(pidGain_t gain, uint32_t multiplier, uint32_t divisor)
+  {
+    uint32_t scaled = mulDiv(gain, multiplier, divisor, true);
+
+    return (scaled > 0x7FFF) ? 0x7FFF : (int32_t)scaled;
+  }
+
+  // Convert the Q16.16 gains per degree Celsius and per second into gains
+  // per input unit and per sample period (Kp & Kd in Q.8, Ki in Q.16)
+  void scaleTunings(void)
+  {
+    kpScaled = scaleGain(dispKp, 1, 1UL << (8 + PID_VALUE_SHIFT));
+    kiScaled = scaleGain(dispKi, sampleTime, 1000UL << PID_VALUE_SHIFT);
+    kdScaled = scaleGain(dispKd, 1000, sampleTime << (8 + PID_VALUE_SHIFT));
+
+    if (controllerDirection == REVERSE)
     {
-      // Thermocouple error (open, shorted)
-      lcd.print(F("TC Error"));
+      kpScaled = -kpScaled;
+      kiScaled = -kiScaled;
+      kdScaled = -kdScaled;
     }
-    else
-    {
-      // Display current temperature
-      lcd.print(input);
-#if ARDUINO >= 100
-      // Display degree Celsius symbol
-      lcd.write((uint8_t)0);
+  }
+
+  pidValue_t *myInput;
+  pidValue_t *myOutput;
+  pidValue_t *mySetpoint;
+  pidGain_t dispKp;
+  pidGain_t dispKi;
+  pidGain_t dispKd;
+  int32_t kpScaled;
+  int32_t kiScaled;
+  int32_t kdScaled;
+  int32_t outputSum;
+  pidValue_t lastInput;
+  pidValue_t outMin;
+  pidValue_t outMax;
+  unsigned long lastTime;
+  unsigned long sampleTime;
+  uint8_t controllerDirection;
+  bool inAuto;
+};
+
+// PID control interface
+FixedPID reflowOvenPID(&input, &output, &setpoint, kp, ki, kd, DIRECT);
 #else
-      // Display degree Celsius symbol
-      lcd.print(0, BYTE);
+// PID control interface
+PID reflowOvenPID(&input, &output, &setpoint, kp, ki, kd, DIRECT);
 #endif
-      lcd.print("C ");
-    }
-#elif VERSION == 2
-    oled.clearDisplay();
-    oled.setTextSize(2);
-    oled.setCursor(0, 0);
-    oled.print(txtBuffer);
-    oled.setTextSize(1);
-    oled.setCursor(115, 0);
+#if VERSION == 2
+// Page buffer, change detection and background flush of the SSD1306
+#include "Adafruit_SSD1306_SB.h"
+#endif
+
+// ***** TELEMETRY SINK *****
+// Ring buffer in front of the UART, records are committed as a whole so that
+// a full buffer drops a complete record instead of blocking the loop
+static_assert((TELEMETRY_BUFFER_SIZE & (TELEMETRY_BUFFER_SIZE - 1)) == 0, "Telemetry buffer size is a power of 2");
+static_assert(TELEMETRY_BUFFER_SIZE >= 128, "Telemetry buffer holds a record and a reply");
+
+#if TELEMETRY_BUFFER_SIZE > 256
+typedef uint16_t telemetryIndex_t;
+#else
+typedef uint8_t telemetryIndex_t;
+#endif
+
+class TelemetrySink : public Print
+{
+public:
+  // Start a new record, bytes are only published by endRecord()
+  void beginRecord(void)
+  {
+    recordHead = head;
+    overflow = false;
+  }
+
+  virtual size_t write(uint8_t data)
+  {
+    telemetryIndex_t next = (recordHead + 1) & (TELEMETRY_BUFFER_SIZE - 1);
 
-    if (reflowProfile == REFLOW_PROFILE_LEADFREE)
+    if (overflow || (next == tail))
     {
-      oled.print(F("LF"));
+      overflow = true;
+      return 0;
     }
-    else if (reflowProfile == REFLOW_PROFILE_LEADED)
+    buffer[recordHead] = data;
+    recordHead = next;
+
+    return 1;
+  }
+  using Print::write;
+
+  // Publish the record or drop it if it did not fit
+  bool endRecord(void)
+  {
+    if (overflow)
     {
-      oled.print(F("PB"));
+      dropped++;
+      return false;
     }
-    else
-    {
-      oled.print(F("BK"));
-    }
-    
-    // Temperature markers
-    oled.setCursor(0, 19);
-    oled.print(F("250"));
-    oled.setCursor(0, 36);
-    oled.print(F("150"));
-    oled.setCursor(0, 54);
-    oled.print(F("50"));
-    // Draw temperature and time axis
-    oled.drawLine(18, 18, 18, 63, WHITE); //left vertical line
-    oled.drawLine(18, 19, 20, 19, WHITE); //250 tick
-    oled.drawLine(18, 36, 20, 36, WHITE); //150 tick
-    oled.drawLine(18, 54, 20, 54, WHITE); //50 tick
-    oled.drawLine(18, 63, 127, 63, WHITE); //bottom horizontal line
-    //time markers, scroll with plot
-    oled.drawLine(38-xScrollOffset, 63, 38-xScrollOffset, 61, WHITE);
-    oled.drawLine(58-xScrollOffset, 63, 58-xScrollOffset, 61, WHITE);
-    oled.drawLine(78-xScrollOffset, 63, 78-xScrollOffset, 61, WHITE);
-    oled.drawLine(98-xScrollOffset, 63, 98-xScrollOffset, 61, WHITE);
-    oled.drawLine(118-xScrollOffset, 63, 118-xScrollOffset, 61, WHITE);
-    if (xScrollOffset>10)
-      oled.drawLine(138-xScrollOffset, 63, 138-xScrollOffset, 61, WHITE);
+    head = recordHead;
 
-    // If currently in error state
-    if (reflowState == REFLOW_STATE_ERROR)
+    return true;
+  }
+
+  // Move as much as the UART transmit buffer can take without waiting
+  void drain(void)
+  {
+    int room = Serial.availableForWrite();
+
+    while ((room-- > 0) && (tail != head))
     {
-      oled.setCursor(80, 9);
-      oled.print(F("TC Error"));
+      Serial.write(buffer[tail]);
+      tail = (tail + 1) & (TELEMETRY_BUFFER_SIZE - 1);
     }
-    else
-    {
-      // Right align temperature reading
-      if (input < 10) oled.setCursor(91, 9);
-      else if (input < 100) oled.setCursor(85,9);
-      else oled.setCursor(80, 9);
-      // Display current temperature
-      oled.print(input);
-      oled.print((char)247);
-      oled.print(F("C"));
+  }
+
+  // Free space for the next record
+  unsigned int room(void)
+  {
+    return (tail - head - 1) & (TELEMETRY_BUFFER_SIZE - 1);
+  }
+
+  // Records dropped since start-up
+  unsigned int dropped;
+
+private:
+  uint8_t buffer[TELEMETRY_BUFFER_SIZE];
+  telemetryIndex_t head;
+  telemetryIndex_t tail;
+  telemetryIndex_t recordHead;
+  bool overflow;
+};
+
+TelemetrySink telemetry;
+
+#if RUN_LOG
+// Page being filled, programmed in one operation once full or at run end
+uint8_t runLogBuffer[RUN_LOG_PAGE_SIZE];
+unsigned int runLogFill;
+// Next page to program and runs in the index
+uint16_t runLogPage;
+uint16_t runLogRuns;
+// Index entry of the run being recorded
+runLogEntry_t runLogEntry;
+bool runLogActive;
+uint8_t runLogSequence;
+// Operations waiting for the flash, one is started per pass
+bool runLogIndexPending;
+bool runLogPagePending;
+bool runLogResultPending;
+bool runLogErasing;
+// Records lost to a full flash or a page still waiting to be programmed
+unsigned int runLogDropped;
+// Download in progress
+uint32_t runLogDumpAddress;
+uint32_t runLogDumpEnd;
+#endif
+
+void sensorTask(void);
+void pidTask(void);
+void reflowTask(void);
+void switchTask(void);
+void settingsTask(void);
+void commandTask(void);
+void heartbeatTask(void);
+void telemetryTask(void);
+#if RUN_LOG
+void runLogTask(void);
+#endif
+template <typename B> void displayTask(void);
+#if OLED_ASYNC_FLUSH
+template <typename B> void displayFlushTask(void);
+#endif
+
+// ***** TASK TABLE *****
+// Tasks run in table order when due, keep it sorted by priority
+task_t tasks[] = {
+#if SENSOR_DRDY
+  { 0, TASK_PRIORITY_CONTROL, 0, sensorTask },
+#else
+  // First conversion completes one period after start-up
+  { SENSOR_CHANNEL_PERIOD, TASK_PRIORITY_CONTROL, SENSOR_CONVERSION_TIME, sensorTask },
+#endif
+  // PID_SAMPLE_TIME is enforced by the PID itself
+  { 0, TASK_PRIORITY_CONTROL, 0, pidTask },
+  { 0, TASK_PRIORITY_CONTROL, 0, reflowTask },
+  // Switch pin changes are timestamped by interrupt, only a ladder is polled
+  { (Board::switchDecoder == SWITCH_DECODER_LADDER) ? SWITCH_POLL_PERIOD : 0, TASK_PRIORITY_NORMAL, 0, switchTask },
+  { 0, TASK_PRIORITY_NORMAL, 0, settingsTask },
+  // Injects switch events, must run after switchTask which clears them
+  { 0, TASK_PRIORITY_NORMAL, 0, commandTask },
+  { SENSOR_SAMPLING_TIME, TASK_PRIORITY_NORMAL, 0, heartbeatTask },
+  { 0, TASK_PRIORITY_NORMAL, 0, telemetryTask },
+#if RUN_LOG
+  { 0, TASK_PRIORITY_NORMAL, 0, runLogTask },
+#endif
+  { UPDATE_RATE, TASK_PRIORITY_DISPLAY, 0, displayTask<Board> },
+#if OLED_ASYNC_FLUSH
+  { 0, TASK_PRIORITY_DISPLAY, 0, displayFlushTask<Board> },
+#endif
+};
+#define TASK_COUNT (sizeof(tasks) / sizeof(tasks[0]))
+
+#if PROFILING
+profileStats_t profileStats[PROFILE_SECTIONS];
+// Number of times each task was serviced later than TASK_LATENESS_MAX
+unsigned int taskMissed[TASK_COUNT];
+// Two headers, a row per section and one per task
+#define PROFILE_DUMP_ROWS (PROFILE_SECTIONS + TASK_COUNT + 2)
+// Widest row, four 32-bit counters after the name
+#define PROFILE_ROW_SIZE 56
+// Next row of an ongoing statistics dump, PROFILE_DUMP_ROWS when none
+unsigned char profileDumpRow = PROFILE_DUMP_ROWS;
+void profileReset(void);
+void profileRecord(profileSection_t section, unsigned long duration);
+void profileDump(void);
+void profileDumpNext(void);
+#endif
+
+#if BENCHMARK
+// Cycle counter, Timer1 overflows extend TCNT1
+volatile uint16_t benchOverflows;
+uint32_t benchStart;
+uint32_t benchOverhead;
+// Cycles of the current run, summed over its timed parts
+uint32_t benchRunCycles;
+// Stack pointer when the path was entered
+uint8_t *benchSp;
+void benchmarkRun(void);
+uint32_t benchCycles(void);
+void benchBegin(void);
+void benchEnd(void);
+void benchDrain(void);
+void benchPaint(void);
+uint8_t *benchLowWater(void);
+void benchPid(void);
+void benchSensor(void);
+void benchFormat(void);
+void benchTelemetry(void);
+template <typename B> void benchRender(void);
+template <typename B> void benchDisplay(void);
+void benchLoop(void);
+
+const bench_t benches[] PROGMEM = {
+  { benchName_1, benchPid },
+  { benchName_2, benchSensor },
+  { benchName_3, benchFormat },
+  { benchName_4, benchTelemetry },
+  { benchName_5, benchRender<Board> },
+  { benchName_6, benchDisplay<Board> },
+  { benchName_7, benchLoop }
+};
+#define BENCH_COUNT (sizeof(benches) / sizeof(benches[0]))
+#endif
+
+template <typename B> switch_t readSwitch(void);
+void switchSample(unsigned long time);
+void pinChangeEnable(uint8_t pin);
+template <typename B> inline void pinChange(void);
+thermocoupleSample_t readThermocouple(unsigned char channel);
+void writeThermocouple(unsigned char channel, uint8_t address, uint8_t value);
+int32_t sensorCombine(void);
+bool sensorInInput(unsigned char channel);
+void sensorError(void);
+#if SENSOR_FAULT_INTERRUPT
+void sensorTripped(void);
+void sensorFaultMask(void);
+#endif
+int32_t sensorFilter(int32_t raw);
+int32_t temperatureTenths(pidValue_t value);
+unsigned char formatTemperature(char *text, pidValue_t value);
+unsigned char formatTenths(char *text, int32_t tenths);
+bool displayDue(void);
+void printTemperature(Print &out, pidValue_t value);
+void sendTelemetry(void);
+void sendTelemetryFrame(void);
+void telemetryFrameBuild(telemetryFrame_t *frame, uint8_t sequence);
+#if RUN_LOG
+void runLogBegin(void);
+void runLogStart(void);
+void runLogRecord(void);
+void runLogDump(void);
+bool runLogDumpStart(uint16_t run);
+void runLogReport(Print &out);
+void flashSelect(uint8_t command);
+void flashDeselect(void);
+void flashAddress(uint32_t address);
+bool flashBusy(void);
+void flashRead(uint32_t address, uint8_t *data, unsigned int length);
+void flashProgram(uint32_t address, const uint8_t *data, unsigned int length);
+#endif
+void runStart(void);
+void runComplete(void);
+void profileStart(void);
+void batchStart(void);
+void batchRearm(void);
+void batchNext(void);
+void batchRunDone(void);
+void batchEnd(void);
+void printBatch(Print &out);
+void segmentEnter(unsigned char index);
+bool segmentDone(void);
+void tuneStart(void);
+void tunePointEnter(unsigned char index);
+void tuneRelay(bool heating);
+void tuneStep(void);
+bool tuneSample(void);
+void tuneGains(pidGains_t *gains);
+uint16_t tuneSqrt(uint32_t value);
+void printProfileName(Print &out, reflowProfile_t profile = reflowProfile);
+unsigned char profileSegmentCount(void);
+void settingsLoad(void);
+bool segmentValid(const reflowSegment_t &custom);
+void settingsChanged(void);
+void selectProfile(reflowProfile_t profile);
+bool commandExecute(char *line);
+char *commandToken(char **cursor);
+bool commandNumber(char **cursor, long *value);
+bool commandGain(char **cursor, pidGain_t *gain);
+void printGain(Print &out, pidGain_t gain);
+void printGains(Print &out, const pidGains_t &gains);
+void plotReset(void);
+void plotAdd(pidValue_t value);
+#if THERMAL_MODEL
+void modelStart(void);
+void modelSample(void);
+void modelFit(void);
+pidValue_t modelFeedForward(void);
+bool modelPeakReached(void);
+#endif
+template <typename B> void fanBegin(void);
+template <typename B> void fanUpdate(void);
+void fanStart(void);
+unsigned int fanControl(void);
+#if IDLE_SLEEP && !BENCHMARK
+void idleSleep(void);
+#endif
+template <typename B> void boardSetup(void);
+template <typename B> void boardLoop(void);
+
+void setup()
+{
+  boardSetup<Board>();
+}
+
+void loop()
+{
+  boardLoop<Board>();
+}
+
+template <typename B>
+void boardSetup(void)
+{
+  typedef typename B::Display Display;
+
+  // Restore selected reflow profile, gains and custom profile
+  settingsLoad();
+  reflowProfile = settings.profile;
+
+  // SSR pin initialization to ensure reflow oven is off
+  digitalWrite(ssrPin, LOW);
+  pinMode(ssrPin, OUTPUT);
+  fanBegin<B>();
+
+  // Buzzer pin initialization to ensure annoying buzzer is off
+  digitalWrite(buzzerPin, LOW);
+  pinMode(buzzerPin, OUTPUT);
+
+  // LED pins initialization and turn on upon start-up (active high)
+  pinMode(ledPin, OUTPUT);
+  digitalWrite(ledPin, HIGH);
+
+  // Initialize thermocouple interfaces, same setup as the library begin()
+  // which only knows a single chip select
+  for (unsigned char channel = 0; channel < SENSOR_CHANNELS; channel++)
+  {
+    digitalWrite(thermocoupleCSPins[channel], HIGH);
+    pinMode(thermocoupleCSPins[channel], OUTPUT);
+  }
+  SPI.begin();
+  for (unsigned char channel = 0; channel < SENSOR_CHANNELS; channel++)
+  {
+    // Assert on any fault, no cold junction offset
+    writeThermocouple(channel, MAX31856_MASK_REG, 0x00);
+    writeThermocouple(channel, MAX31856_CJTO_REG, 0x00);
+    // Filter and averaging only change while conversions are stopped
+    writeThermocouple(channel, MAX31856_CR0_REG, MAX31856_CR0_OCFAULT0 |
+                      (SENSOR_NOTCH_50HZ ? SENSOR_CR0_NOTCH_50HZ : 0));
+    writeThermocouple(channel, MAX31856_CR1_REG, (SENSOR_AVERAGING_SELECT << 4) | MAX31856_TCTYPE_K);
+    // Let the MAX31856 convert on its own, we only collect the results
+    writeThermocouple(channel, MAX31856_CR0_REG, MAX31856_CR0_AUTOCONVERT | MAX31856_CR0_OCFAULT0 |
+                      (SENSOR_NOTCH_50HZ ? SENSOR_CR0_NOTCH_50HZ : 0));
+  }
+#if SENSOR_DRDY
+  pinMode(thermocoupleDrdyPin, INPUT);
+#endif
+#if SENSOR_FAULT_INTERRUPT
+  // Open drain, shared by all channels
+  pinMode(B::thermocoupleFaultPin, INPUT_PULLUP);
+  sensorFaultMask();
+  pinChangeEnable(B::thermocoupleFaultPin);
+#endif
+  // Switch changes are tracked from here on
+  switchLevel = readSwitch<B>();
+  if constexpr (B::switchDecoder == SWITCH_DECODER_DIGITAL)
+  {
+    pinChangeEnable(B::switchStartStopPin);
+    pinChangeEnable(B::switchLfPbPin);
+  }
+#if RUN_LOG
+  // Find the end of the log
+  runLogBegin();
+#endif
+
+  // Start-up splash
+  digitalWrite(buzzerPin, HIGH);
+  Display::begin();
+  digitalWrite(buzzerPin, LOW);
+  delay(1000);
+  Display::splash();
+
+  // Serial communication at 115200 bps
+  Serial.begin(115200);
+
+  // Turn off LED (active high)
+  digitalWrite(ledPin, LOW);
+  // Set window size
+  windowSize = SSR_WINDOW_SIZE;
+  // Timer1 in CTC mode @ 1 kHz (prescaler 64) drives the SSR output
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS11) | _BV(CS10);
+  OCR1A = (F_CPU / 64 / 1000) - 1;
+  // Timer1 bits only, the ATtiny1634 TIMSK also holds the millis() overflow
+  TIMER1_FLAGS = _BV(OCF1A);
+  TIMER1_MASK |= _BV(OCIE1A);
+#if IDLE_SLEEP && !BENCHMARK
+  // Timers keep counting while idle, millis() and the SSR window stay exact
+  set_sleep_mode(SLEEP_MODE_IDLE);
+#endif
+#if PROFILING
+  profileReset();
+#endif
+  // Initialize task deadlines, relative to now
+  currentTime = millis();
+  for (unsigned char index = 0; index < TASK_COUNT; index++)
+  {
+    tasks[index].deadline += currentTime;
+  }
+#if BENCHMARK
+  // Does not return
+  benchmarkRun();
+#endif
+}
+
+template <typename B>
+void boardLoop(void)
+{
+  unsigned char index;
+  bool controlLate = false;
+
+  // Sample the clock once for the whole scheduler pass
+  currentTime = millis();
+  PROFILE_START(PROFILE_LOOP);
+
+  for (index = 0; index < TASK_COUNT; index++)
+  {
+    task_t *task = &tasks[index];
+    // Rollover safe deadline check
+    long lateness = (long)(currentTime - task->deadline);
+
+    // Not due yet
+    if (lateness < 0) continue;
+
+    // Control tasks are behind schedule, keep the bus and CPU for them
+    if (controlLate && (task->priority >= TASK_PRIORITY_DISPLAY)) continue;
+
+    if ((task->period != 0) && (lateness > TASK_LATENESS_MAX))
+    {
+#if PROFILING
+      taskMissed[index]++;
+#endif
+      if (task->priority == TASK_PRIORITY_CONTROL) controlLate = true;
     }
-    
-    if (reflowStatus == REFLOW_STATUS_ON)
+
+    // Polled tasks run on every pass, others catch up on missed periods
+    if (task->period == 0) task->deadline = currentTime;
+    else task->deadline += task->period;
+
+    task->callback();
+  }
+  PROFILE_END(PROFILE_LOOP);
+#if IDLE_SLEEP && !BENCHMARK
+  idleSleep();
+#endif
+}
+
+#if IDLE_SLEEP && !BENCHMARK
+// Idle until the next interrupt unless a periodic task fell due meanwhile.
+// The 1 ms Timer1 tick bounds the sleep, so polled tasks still run every
+// millisecond, UART, TWI and pin changes wake the CPU earlier.
+void idleSleep(void)
+{
+  cli();
+  unsigned long now = millis();
+  for (unsigned char index = 0; index < TASK_COUNT; index++)
+  {
+    if ((tasks[index].period != 0) && ((long)(now - tasks[index].deadline) >= 0))
+    {
+      sei();
+      return;
+    }
+  }
+  sleep_enable();
+  // An interrupt raised since cli() is taken right after sleep_cpu() and
+  // wakes the CPU at once, none is lost between the check and the sleep
+  sei();
+  sleep_cpu();
+  sleep_disable();
+}
+#endif
+
+// Collect a fresh conversion from the next channel
+void sensorTask(void)
+{
+#if SENSOR_DRDY
+  // DRDY is asserted low until the temperature registers are read
+  if (digitalRead(thermocoupleDrdyPin) == HIGH) return;
+
+#endif
+  // Read current temperature and fault status in a single transaction
+  PROFILE_START(PROFILE_SENSOR);
+  thermocoupleSample_t sample = readThermocouple(sensorChannel);
+  PROFILE_END(PROFILE_SENSOR);
+  sensorTemperature[sensorChannel] = sample.temperature;
+  sensorFault[sensorChannel] = sample.fault;
+  // Control input moves on once per round over the channels
+  if (++sensorChannel < SENSOR_CHANNELS) return;
+  sensorChannel = 0;
+
+  int32_t temperature = sensorCombine();
+  inputRaw = TEMPERATURE_RAW(temperature);
+  if (fault & SENSOR_FAULT_MASK)
+  {
+#if SENSOR_MEDIAN || SENSOR_IIR_SHIFT
+    // Do not let a faulty sample into the filter history
+    sensorPrimed = false;
+#endif
+    input = inputRaw;
+  }
+  else
+  {
+    input = TEMPERATURE_RAW(sensorFilter(temperature));
+  }
+  // Every sample reaches the plot so that short excursions stay visible
+  if constexpr (Board::hasPlot)
+  {
+    if (reflowStatus == REFLOW_STATUS_ON) plotAdd(input);
+  }
+#if SENSOR_FAULT_INTERRUPT
+  // Follow cleared faults and control input changes
+  sensorFaultMask();
+#endif
+
+  // If any thermocouple fault is detected
+  if (fault & SENSOR_FAULT_MASK) sensorError();
+}
+
+// Thermocouple fault, stops the reflow process
+void sensorError(void)
+{
+  // Only report once when entering error state
+  if (reflowState != REFLOW_STATE_ERROR)
+  {
+    telemetry.beginRecord();
+    telemetry.println(F("Error"));
+    telemetry.endRecord();
+  }
+  // Illegal operation
+  reflowState = REFLOW_STATE_ERROR;
+  reflowStatus = REFLOW_STATUS_OFF;
+}
+
+#if SENSOR_FAULT_INTERRUPT
+// FAULT pin asserted, the SSR is already off
+void sensorTripped(void)
+{
+  // Status of every channel now rather than on their next sample
+  for (unsigned char channel = 0; channel < SENSOR_CHANNELS; channel++)
+  {
+    sensorFault[channel] = readThermocouple(channel).fault;
+  }
+  sensorCombine();
+  // A tolerated fault lets the SSR resume, masking it releases the pin
+  if (fault & SENSOR_FAULT_MASK) sensorError();
+  sensorFaultMask();
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (reflowStatus == REFLOW_STATUS_OFF) ssrDuty = 0;
+    sensorTrip = false;
+  }
+}
+
+// Let FAULT assert only for channels of the control input, and with
+// SENSOR_FAULT_TOLERANT only for those not already faulted
+void sensorFaultMask(void)
+{
+  for (unsigned char channel = 0; channel < SENSOR_CHANNELS; channel++)
+  {
+    bool trips = sensorInInput(channel) &&
+                 !(SENSOR_FAULT_TOLERANT && (sensorFault[channel] & SENSOR_FAULT_MASK));
+    uint8_t mask = trips ? 0x00 : 0xFF;
+
+    if (mask == sensorFaultOutput[channel]) continue;
+    writeThermocouple(channel, MAX31856_MASK_REG, mask);
+    sensorFaultOutput[channel] = mask;
+  }
+}
+#endif
+
+// PID computation, SSR is switched by the Timer1 ISR
+void pidTask(void)
+{
+#if SENSOR_FAULT_INTERRUPT
+  if (sensorTrip) sensorTripped();
+#endif
+  if (reflowStatus == REFLOW_STATUS_ON)
+  {
+    PROFILE_START(PROFILE_PID);
+    // The relay drives output while tuning, sampled at the PID rate
+    if ((reflowState == REFLOW_STATE_TUNE) ? tuneSample() : reflowOvenPID.Compute())
     {
-      // We are updating the display faster than sensor reading
-      if (timerSeconds > timerUpdate)
+      // Only account for passes where a new output was computed
+      PROFILE_END(PROFILE_PID);
+      pidValue_t duty = output;
+#if THERMAL_MODEL
+      // Accounts for the duty applied over the last sample
+      modelSample();
+      duty += modelFeedForward();
+      if (duty < 0) duty = 0;
+      else if (duty > (pidValue_t)windowSize) duty = windowSize;
+#endif
+      unsigned int fan = Board::hasFan ? fanControl() : 0;
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
       {
-        // Store temperature reading every 3 s
-        if ((timerSeconds % 3) == 0)
-        {
-          timerUpdate = timerSeconds;
-          unsigned char averageReading = map(input, 0, 250, 63, 19);
-          if (xCnt < (SCREEN_WIDTH - X_AXIS_START)) //haven't filled entire screen yet
-          {
-            temperature[xCnt++] = averageReading;
-          }
-          else //screen full, scroll graph
-          {
-            temperature[xHead++] = averageReading;
-            if (xHead == (SCREEN_WIDTH - X_AXIS_START))
-              xHead=0;
-            xScrollOffset++;
-            if (xScrollOffset>19)
-              xScrollOffset=0;
-          }
-        }
+        ssrDuty = (unsigned int)duty;
+        fanDuty = fan;
+      }
+
+      // Decimated telemetry record of this sample
+      if (++telemetryDecimationCount >= telemetryDecimation)
+      {
+        telemetryDecimationCount = 0;
+        sendTelemetry();
       }
+#if RUN_LOG
+      // Every sample is logged
+      runLogRecord();
+#endif
     }
-    
-    unsigned char timeAxis, tElem;
-    tElem=xHead;
-    for (timeAxis = 0; timeAxis < xCnt; timeAxis++)
+  }
+  // Reflow oven process is off, ensure oven is off
+  else
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-      oled.drawPixel(timeAxis + X_AXIS_START, temperature[tElem++], WHITE);
-      if (tElem==(SCREEN_WIDTH - X_AXIS_START))
-        tElem=0;
+      ssrDuty = 0;
+      fanDuty = 0;
     }
-    
-    // Update screen
-    oled.display();
-#endif
   }
+}
+
+// Reflow process and switch actions
+void reflowTask(void)
+{
+  PROFILE_START(PROFILE_REFLOW);
 
   // Reflow oven controller state machine
   switch (reflowState)
   {
     case REFLOW_STATE_IDLE:
       // If oven temperature is still above room temperature
-      if (input >= TEMPERATURE_ROOM)
+      if (input >= TEMPERATURE(TEMPERATURE_ROOM))
       {
         reflowState = REFLOW_STATE_TOO_HOT;
       }
       else
       {
         // If switch is pressed to start reflow process
-        if (switchStatus == SWITCH_1)
+        if ((switchStatus == SWITCH_1) && (profileSegmentCount() != 0))
         {
-          // Send header for CSV file
-          Serial.println(F("Time,Setpoint,Input,Output"));
-          // Intialize seconds timer for serial debug information
-          timerSeconds = 0;
-          
-          #if VERSION == 2
-          // Initialize reflow plot update timer
-          timerUpdate = 0;
-          xHead = 0;
-          xCnt = 0;
-          xScrollOffset=0;
-          #endif
-          
-          // Initialize PID control window starting time
-          windowStartTime = millis();
-
-          // Either enter Bake or continue with chosen reflow profile
-          if (reflowProfile == REFLOW_PROFILE_BAKE)
-          {
-            setpoint = TEMPERATURE_BAKE;
-            // Tell the PID to range between 0 and the full window size
-            reflowOvenPID.SetOutputLimits(0, windowSize);
-            reflowOvenPID.SetSampleTime(PID_SAMPLE_TIME);
-            // Turn the PID on
-            reflowOvenPID.SetMode(AUTOMATIC);
-            // Proceed to bake stage
-            reflowState = REFLOW_STATE_BAKE;
-          }
-          else
-          {
-            // Ramp up to minimum soaking temperature
-            setpoint = TEMPERATURE_SOAK_MIN;
-            // Load profile specific constant
-            if (reflowProfile == REFLOW_PROFILE_LEADFREE)
-            {
-              soakTemperatureMax = TEMPERATURE_SOAK_MAX_LF;
-              reflowTemperatureMax = TEMPERATURE_REFLOW_MAX_LF;
-              soakMicroPeriod = SOAK_MICRO_PERIOD_LF;
-            }
-            else
-            {
-              soakTemperatureMax = TEMPERATURE_SOAK_MAX_PB;
-              reflowTemperatureMax = TEMPERATURE_REFLOW_MAX_PB;
-              soakMicroPeriod = SOAK_MICRO_PERIOD_PB;
-            }
-            // Tell the PID to range between 0 and the full window size
-            reflowOvenPID.SetOutputLimits(0, windowSize);
-            reflowOvenPID.SetSampleTime(PID_SAMPLE_TIME);
-            // Turn the PID on
-            reflowOvenPID.SetMode(AUTOMATIC);
-            // Proceed to preheat stage
-            reflowState = REFLOW_STATE_PREHEAT;
-          }
+          profileStart();
+          // This press started the run, do not cancel it below
+          switchStatus = SWITCH_NONE;
         }
       }
       break;
 
     case REFLOW_STATE_PREHEAT:
-      reflowStatus = REFLOW_STATUS_ON;
-      // If minimum soak temperature is achieve
-      if (input >= TEMPERATURE_SOAK_MIN)
-      {
-        // Chop soaking period into smaller sub-period
-        timerSoak = millis() + soakMicroPeriod;
-        // Set less agressive PID parameters for soaking ramp
-        reflowOvenPID.SetTunings(PID_KP_SOAK, PID_KI_SOAK, PID_KD_SOAK);
-        // Ramp up to first section of soaking temperature
-        setpoint = TEMPERATURE_SOAK_MIN + SOAK_TEMPERATURE_STEP;
-        // Proceed to soaking state
-        reflowState = REFLOW_STATE_SOAK;
-      }
-      break;
-
     case REFLOW_STATE_SOAK:
-      // If micro soak temperature is achieved
-      if (millis() > timerSoak)
+    case REFLOW_STATE_REFLOW:
+    case REFLOW_STATE_COOL:
+    case REFLOW_STATE_BAKE:
+      // If exit condition of the current segment is met
+      if (segmentDone())
       {
-        timerSoak = millis() + soakMicroPeriod;
-        // Increment micro setpoint
-        setpoint += SOAK_TEMPERATURE_STEP;
-        if (setpoint > soakTemperatureMax)
+        if (++segmentIndex < segmentEnd)
+        {
+          // Proceed to next segment
+          segmentEnter(segmentIndex);
+        }
+        else
         {
-          // Set agressive PID parameters for reflow ramp
-          reflowOvenPID.SetTunings(PID_KP_REFLOW, PID_KI_REFLOW, PID_KD_REFLOW);
-          // Ramp up to first section of soaking temperature
-          setpoint = reflowTemperatureMax;
-          // Proceed to reflowing state
-          reflowState = REFLOW_STATE_REFLOW;
+          runComplete();
         }
       }
       break;
 
-    case REFLOW_STATE_REFLOW:
-      // We need to avoid hovering at peak temperature for too long
-      // Crude method that works like a charm and safe for the components
-      if (input >= (reflowTemperatureMax - 5))
-      {
-        // Set PID parameters for cooling ramp
-        reflowOvenPID.SetTunings(PID_KP_REFLOW, PID_KI_REFLOW, PID_KD_REFLOW);
-        // Ramp down to minimum cooling temperature
-        setpoint = TEMPERATURE_COOL_MIN;
-        // Proceed to cooling state
-        reflowState = REFLOW_STATE_COOL;
-      }
+    case REFLOW_STATE_TUNE:
+      tuneStep();
       break;
 
-    case REFLOW_STATE_COOL:
-      // If minimum cool temperature is achieve
-      if (input <= TEMPERATURE_COOL_MIN)
+    case REFLOW_STATE_REARM:
+      // Switch 1 confirms the next run ahead of time, switch 2 ends the batch
+      if (switchStatus == SWITCH_1)
+      {
+        batchConfirmed = true;
+      }
+      else if (switchStatus == SWITCH_2)
+      {
+        batchEnd();
+      }
+      switchStatus = SWITCH_NONE;
+      if (batchConfirmed &&
+          (input <= TEMPERATURE(BATCH_REARM_TEMPERATURE + BATCH_REARM_MARGIN)) &&
+          (input >= TEMPERATURE(BATCH_REARM_TEMPERATURE - BATCH_REARM_MARGIN)))
       {
-        // Retrieve current time for buzzer usage
-        buzzerPeriod = millis() + 1000;
-        // Turn on buzzer to indicate completion
-        digitalWrite(buzzerPin, HIGH);
-        // Turn off reflow process
-        reflowStatus = REFLOW_STATUS_OFF;
-        // Proceed to reflow Completion state
-        reflowState = REFLOW_STATE_COMPLETE;
+        batchNext();
       }
       break;
 
     case REFLOW_STATE_COMPLETE:
-      if (millis() > buzzerPeriod)
+      if ((long)(currentTime - buzzerPeriod) > 0)
       {
         // Turn off buzzer
         digitalWrite(buzzerPin, LOW);
-        // Reflow process ended
-        reflowState = REFLOW_STATE_IDLE;
+        // Reflow process ended, a batch holds the oven for its next run
+        if (batchActive) batchRearm();
+        else reflowState = REFLOW_STATE_IDLE;
       }
       break;
 
     case REFLOW_STATE_TOO_HOT:
       // If oven temperature drops below room temperature
-      if (input < TEMPERATURE_ROOM)
+      if (input < TEMPERATURE(TEMPERATURE_ROOM))
       {
         // Ready to reflow
         reflowState = REFLOW_STATE_IDLE;
@@ -808,18 +2025,11 @@ void loop()
       break;
 
     case REFLOW_STATE_ERROR:
-      // Check for thermocouple fault
-      fault = thermocouple.readFault();
-
+      // A fault ends the batch
+      if (batchActive) batchEnd();
+      // Fault status is refreshed with every thermocouple sample
       // If thermocouple problem is still present
-      if ((fault & MAX31856_FAULT_CJRANGE) ||
-          (fault & MAX31856_FAULT_TCRANGE) ||
-          (fault & MAX31856_FAULT_CJHIGH) ||
-          (fault & MAX31856_FAULT_CJLOW) ||
-          (fault & MAX31856_FAULT_TCHIGH) ||
-          (fault & MAX31856_FAULT_TCLOW) ||
-          (fault & MAX31856_FAULT_OVUV) ||
-          (fault & MAX31856_FAULT_OPEN))
+      if (fault & SENSOR_FAULT_MASK)
       {
         // Wait until thermocouple wire is connected
         reflowState = REFLOW_STATE_ERROR;
@@ -830,11 +2040,6 @@ void loop()
         reflowState = REFLOW_STATE_IDLE;
       }
       break;
-
-   case REFLOW_STATE_BAKE:
-    reflowStatus = REFLOW_STATUS_ON;
-    reflowOvenPID.SetTunings(PID_KP_BAKE, PID_KI_BAKE, PID_KD_BAKE);
-    break;
   }
 
   // If switch 1 is pressed
@@ -843,7 +2048,8 @@ void loop()
     // If currently reflow process is on going
     if (reflowStatus == REFLOW_STATUS_ON)
     {
-      // Button press is for cancelling
+      // Button press is for cancelling, of the whole batch if any
+      if (batchActive) batchEnd();
       // Turn off reflow process
       reflowStatus = REFLOW_STATUS_OFF;
       // Reinitialize state machine
@@ -856,64 +2062,57 @@ void loop()
     // Only can switch reflow profile during idle
     if (reflowState == REFLOW_STATE_IDLE)
     {
-      // Currently using lead-free reflow profile
-      if (reflowProfile == REFLOW_PROFILE_LEADFREE)
-      {
-        // Switch to leaded reflow profile
-        reflowProfile = REFLOW_PROFILE_LEADED;
-        EEPROM.write(PROFILE_TYPE_ADDRESS, 1);
-      }
-      // Currently using leaded reflow profile
-      else if (reflowProfile == REFLOW_PROFILE_LEADED)
-      {
-        // Switch to bake profile
-        reflowProfile = REFLOW_PROFILE_BAKE;
-        EEPROM.write(PROFILE_TYPE_ADDRESS, 2);
-      }
-      else
-      {
-        // Switch to lead-free profile
-        reflowProfile = REFLOW_PROFILE_LEADFREE;
-        EEPROM.write(PROFILE_TYPE_ADDRESS, 0);
-      }
+      // Cycle through the profile table
+      selectProfile(static_cast<reflowProfile_t>((reflowProfile + 1) % REFLOW_PROFILE_COUNT));
     }
   }
   // Switch status has been read
   switchStatus = SWITCH_NONE;
+  PROFILE_END(PROFILE_REFLOW);
+}
+
+// Switch debounce, on the level changes timestamped by switchSample()
+void switchTask(void)
+{
+  switch_t switchValue;
+
+  // Ladder levels raise no pin changes, sample it instead
+  if constexpr (Board::switchDecoder == SWITCH_DECODER_LADDER) switchSample(currentTime);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    switchValue = switchLevel;
+    // Every bounce restarts the debounce period
+    if (switchEdge) lastDebounceTime = switchEdgeTime;
+    switchEdge = false;
+  }
 
-  // Simple switch debounce state machine (analog switch)
+  // Simple switch debounce state machine
   switch (debounceState)
   {
     case DEBOUNCE_STATE_IDLE:
       // No valid switch press
       switchStatus = SWITCH_NONE;
 
-      switchValue = readSwitch();
-
       // If either switch is pressed
       if (switchValue != SWITCH_NONE)
       {
         // Keep track of the pressed switch
         switchMask = switchValue;
-        // Intialize debounce counter
-        lastDebounceTime = millis();
         // Proceed to check validity of button press
         debounceState = DEBOUNCE_STATE_CHECK;
       }
       break;
 
     case DEBOUNCE_STATE_CHECK:
-      switchValue = readSwitch();
+      // Wait for minimum debounce period without a change, an edge taken
+      // by the ISR after currentTime was read counts as just now
+      if ((long)(currentTime - lastDebounceTime) <= DEBOUNCE_PERIOD_MIN) break;
       if (switchValue == switchMask)
       {
-        // If minimum debounce period is completed
-        if ((millis() - lastDebounceTime) > DEBOUNCE_PERIOD_MIN)
-        {
-          // Valid switch press
-          switchStatus = switchMask;
-          // Proceed to wait for button release
-          debounceState = DEBOUNCE_STATE_RELEASE;
-        }
+        // Valid switch press
+        switchStatus = switchMask;
+        // Proceed to wait for button release
+        debounceState = DEBOUNCE_STATE_RELEASE;
       }
       // False trigger
       else
@@ -924,7 +2123,6 @@ void loop()
       break;
 
     case DEBOUNCE_STATE_RELEASE:
-      switchValue = readSwitch();
       if (switchValue == SWITCH_NONE)
       {
         // Reinitialize button debounce state machine
@@ -932,48 +2130,2613 @@ void loop()
       }
       break;
   }
+}
 
-  // PID computation and SSR control
+// System heart beat, every second
+void heartbeatTask(void)
+{
+  // If reflow process is on going
   if (reflowStatus == REFLOW_STATUS_ON)
   {
-    now = millis();
+    // Toggle red LED as system heart beat
+    digitalWrite(ledPin, !(digitalRead(ledPin)));
+    // Increase seconds timer for reflow curve plot
+    timerSeconds++;
+  }
+  else
+  {
+    // Turn off red LED
+    digitalWrite(ledPin, LOW);
+  }
+}
+
+// Collect a serial command line from the RX buffer, never waits for input
+void commandTask(void)
+{
+  // Bounded work per pass, the rest stays in the RX buffer
+  unsigned char budget = COMMAND_BUFFER_SIZE;
 
-    reflowOvenPID.Compute();
+  while (budget-- && Serial.available())
+  {
+    char data = Serial.read();
 
-    if ((now - windowStartTime) > windowSize)
+    if (data == '\r')
     {
-      // Time to shift the Relay Window
-      windowStartTime += windowSize;
+      continue;
+    }
+    if (data == '\n')
+    {
+      bool success = false;
+
+      commandBuffer[commandLength] = '\0';
+      if (!commandOverflow)
+      {
+        success = commandExecute(commandBuffer);
+      }
+      commandLength = 0;
+      commandOverflow = false;
+      // Data commands answer with their own line
+      if (!success)
+      {
+        telemetry.beginRecord();
+        telemetry.println(F("err"));
+        telemetry.endRecord();
+      }
+      // One command per pass
+      return;
+    }
+    if (commandLength < (COMMAND_BUFFER_SIZE - 1))
+    {
+      commandBuffer[commandLength++] = data;
+    }
+    else
+    {
+      commandOverflow = true;
     }
-    if (output > (now - windowStartTime)) digitalWrite(ssrPin, HIGH);
-    else digitalWrite(ssrPin, LOW);
-  }
-  // Reflow oven process is off, ensure oven is off
-  else
-  {
-    digitalWrite(ssrPin, LOW);
   }
 }
 
-switch_t readSwitch(void)
+// Write pending settings to the next slot, one EEPROM byte at a time
+void settingsTask(void)
 {
-#if VERSION == 1
-  int switchAdcValue = 0;
-  // Analog multiplexing switch
-  switchAdcValue = analogRead(switchPin);
+  if (!settingsWriting)
+  {
+    // Coalesce changes and keep EEPROM writes away from a running process
+    if (!settingsDirty || (reflowStatus == REFLOW_STATUS_ON) ||
+        ((long)(currentTime - settingsChangeTime) < SETTINGS_WRITE_DELAY))
+    {
+      return;
+    }
+    settingsDirty = false;
+    settings.sequence++;
+    settingsSlot = (settingsSlot + 1) % SETTINGS_SLOTS;
+    settingsOffset = 0;
+    settingsCrc = 0xFFFF;
+    settingsWriting = true;
+  }
 
-  // Add some allowance (+10 ADC step) as ADC reading might be off a little
-  // due to 3V3 deviation and also resistor value tolerance
-  if (switchAdcValue >= 1000) return SWITCH_NONE;
-  if (switchAdcValue <= 10) return SWITCH_1;
-  if (switchAdcValue <= 522) return SWITCH_2;
+  // Never wait for the EEPROM, unchanged bytes are skipped by update()
+  while (eeprom_is_ready())
+  {
+    int address = settingsSlot * SETTINGS_SLOT_SIZE + settingsOffset;
 
-#elif VERSION == 2
-  // Switch connected directly to individual separate pins
-  if (digitalRead(switchStartStopPin) == LOW) return SWITCH_1;
-  if (digitalRead(switchLfPbPin) == LOW) return SWITCH_2;
+    // CRC covers the bytes as written, a change made meanwhile is marked
+    // dirty and lands in the following record
+    if (settingsOffset < sizeof(settings))
+    {
+      uint8_t data = ((const uint8_t *)&settings)[settingsOffset];
+
+      settingsCrc = _crc_xmodem_update(settingsCrc, data);
+      EEPROM.update(address, data);
+    }
+    else if (settingsOffset == sizeof(settings))
+    {
+      EEPROM.update(address, settingsCrc >> 8);
+    }
+    else
+    {
+      EEPROM.update(address, settingsCrc & 0xFF);
+      settingsWriting = false;
+      break;
+    }
+    settingsOffset++;
+  }
+}
 
+// Feed buffered telemetry to the UART
+void telemetryTask(void)
+{
+#if PROFILING
+  if (profileDumpRow < PROFILE_DUMP_ROWS) profileDumpNext();
 #endif
+  telemetry.drain();
+}
+
+// ***** DISPLAY BACKENDS *****
+// Both follow the page loop of the SSD1306 driver: firstPage(), then
+// render() and display() for every page until nextPage() is false. The LCD
+// is written while rendering and has a single page with nothing to send.
+template <typename B>
+class LcdDisplay
+{
+public:
+  static constexpr bool asyncFlush = false;
+
+  // Start-up screen, also loads the degree symbol
+  static void begin(void)
+  {
+    lcd.begin(B::screenWidth, B::screenHeight);
+    lcd.createChar(0, degree);
+    lcd.clear();
+    lcd.print(F(" Tiny  "));
+    lcd.setCursor(0, 1);
+    lcd.print(F(" Reflow "));
+  }
+
+  // Version screen, held for 2 s
+  static void splash(void)
+  {
+    lcd.clear();
+    lcd.print(F(" v1.00  "));
+    lcd.setCursor(0, 1);
+    lcd.print(F("26-07-17"));
+    delay(2000);
+    lcd.clear();
+  }
+
+  static void firstPage(void)
+  {
+  }
+
+  static bool nextPage(void)
+  {
+    return false;
+  }
+
+  static bool rendering(void)
+  {
+    return false;
+  }
+
+  static void display(void)
+  {
+  }
+
+  static void invalidate(void)
+  {
+  }
+
+  // Overwrite both rows in place, padded, rather than clearing the LCD
+  static void render(void)
+  {
+    char txtBuffer[8];
+    unsigned char column;
+
+    strcpy_P(txtBuffer, (char *)pgm_read_word(&(lcdMessagesReflowStatus[reflowState])));
+    lcd.setCursor(0, 0);
+    // Print current system state
+    column = lcd.print(txtBuffer);
+    while (column++ < 6) lcd.print(' ');
+    printProfileName(lcd);
+    lcd.setCursor(0, 1);
+
+    // If currently in error state
+    if (reflowState == REFLOW_STATE_ERROR)
+    {
+      // Thermocouple error (open, shorted)
+      lcd.print(F("TC Error"));
+    }
+    else
+    {
+      formatTemperature(txtBuffer, input);
+      // Display current temperature
+      column = lcd.print(txtBuffer);
+#if ARDUINO >= 100
+      // Display degree Celsius symbol
+      lcd.write((uint8_t)0);
+#else
+      // Display degree Celsius symbol
+      lcd.print(0, BYTE);
+#endif
+      column += lcd.print('C') + 1;
+      while (column++ < 8) lcd.print(' ');
+    }
+  }
+
+private:
+  static typename B::Panel lcd;
+};
+
+template <typename B>
+typename B::Panel LcdDisplay<B>::lcd(B::lcdRsPin, B::lcdEPin, B::lcdD4Pin,
+                                      B::lcdD5Pin, B::lcdD6Pin, B::lcdD7Pin);
+
+template <typename B>
+class OledDisplay
+{
+  typedef typename B::Panel Panel;
+
+public:
+  static constexpr bool asyncFlush = OLED_ASYNC_FLUSH;
+
+  // Blank the display RAM
+  static void begin(void)
+  {
+    static_assert((B::xAxisStart + 3) == CHROME_WIDTH, "Static layer ends with the Y-axis ticks");
+
+    oled.begin();
+    oled.firstPage();
+    do
+    {
+      oled.display();
+    } while (oled.nextPage());
+  }
+
+  // Version screen, held for 2 s
+  static void splash(void)
+  {
+    oled.setTextColor(Panel::foreground);
+    oled.firstPage();
+    do
+    {
+      splashRender();
+      oled.display();
+    } while (oled.nextPage());
+    delay(2000);
+  }
+
+  static void firstPage(void)
+  {
+    oled.firstPage();
+  }
+
+  static bool nextPage(void)
+  {
+    return oled.nextPage();
+  }
+
+  static bool rendering(void)
+  {
+    return oled.rendering();
+  }
+
+  static void display(void)
+  {
+    oled.display();
+  }
+
+  static bool displayAsync(void)
+  {
+    return oled.displayAsync();
+  }
+
+  static bool displayBusy(void)
+  {
+    return oled.displayBusy();
+  }
+
+  static void invalidate(void)
+  {
+    oled.invalidate();
+  }
+
+  // Draw the scene from displayShown, called once per page. Pages rendered
+  // on later passes must not see newer values or the frame tears.
+  static void render(void)
+  {
+    const displaySnapshot_t &shown = displayShown;
+    char txtBuffer[8];
+
+    // Static layer first, it overwrites the pages it covers
+    oled.drawPages(displayChrome, CHROME_FIRST_PAGE, CHROME_PAGES, CHROME_WIDTH);
+
+    strcpy_P(txtBuffer, (char *)pgm_read_word(&(lcdMessagesReflowStatus[shown.state])));
+    oled.setTextSize(2);
+    oled.setCursor(0, 0);
+    oled.print(txtBuffer);
+    oled.setTextSize(1);
+    oled.setCursor(115, 0);
+    printProfileName(oled, shown.profile);
+    // Time markers every minute, every 10 minutes once columns span 8 s
+    unsigned int tickPeriod = (shown.plotSpan < 8) ? 60 : 600;
+    unsigned long columnPeriod = (unsigned long)shown.plotSpan * PLOT_PERIOD;
+    unsigned long plotTime = shown.plotCount * columnPeriod / 1000;
+    for (unsigned long tick = tickPeriod; tick < plotTime; tick += tickPeriod)
+    {
+      unsigned char x = B::xAxisStart + (tick * 1000) / columnPeriod;
+      oled.drawLine(x, 63, x, 61, Panel::foreground);
+    }
+
+    // If currently in error state
+    if (shown.state == REFLOW_STATE_ERROR)
+    {
+      oled.setCursor(80, TEMPERATURE_PAGE * 8);
+      oled.print(F("TC Error"));
+    }
+    else
+    {
+      char text[TEMPERATURE_TEXT_SIZE];
+      unsigned char length = formatTenths(text, shown.temperature);
+
+      // Right align reading, degree sign and unit
+      drawTemperature(TEMPERATURE_RIGHT - ((length + 2) * GLYPH_WIDTH), TEMPERATURE_PAGE, text);
+    }
+
+    // Whole run, one vertical span per column. plotAdd() leaves the earlier
+    // columns alone while a frame is rendered, the last one may still grow.
+    for (unsigned char column = 0; column < shown.plotCount; column++)
+    {
+      bool last = column == (shown.plotCount - 1);
+      unsigned char top = last ? shown.plotTop : plotTop[column];
+      unsigned char bottom = last ? shown.plotBottom : plotBottom[column];
+
+      oled.drawFastVLine(column + B::xAxisStart, top, bottom - top + 1, Panel::foreground);
+    }
+  }
+
+private:
+  // Write a formatted temperature followed by the unit from the glyph table,
+  // bypassing the GFX pixel path
+  static void drawTemperature(int16_t x, uint8_t page, const char *text)
+  {
+    uint8_t glyph;
+
+    for (; *text != '\0'; text++)
+    {
+      if (*text == '.') glyph = GLYPH_POINT;
+      else if (*text == '-') glyph = GLYPH_MINUS;
+      else glyph = *text - '0';
+      oled.drawColumns(x, page, temperatureGlyphs[glyph], GLYPH_WIDTH);
+      x += GLYPH_WIDTH;
+    }
+    oled.drawColumns(x, page, temperatureGlyphs[GLYPH_DEGREE], GLYPH_WIDTH);
+    oled.drawColumns(x + GLYPH_WIDTH, page, temperatureGlyphs[GLYPH_CELSIUS], GLYPH_WIDTH);
+  }
+
+  static void splashRender(void)
+  {
+    oled.setTextSize(1);
+    oled.setCursor(0, 0);
+    oled.println(F("     Tiny Reflow"));
+    oled.println(F("     Controller"));
+    oled.println();
+    oled.println(F("       v2.10"));
+    oled.println();
+    oled.println(F("      01-05-20"));
+  }
+
+  static Panel oled;
+};
+
+template <typename B>
+typename OledDisplay<B>::Panel OledDisplay<B>::oled(B::screenWidth, B::screenHeight, &Wire);
+
+// Render current status when it changed, polled every UPDATE_RATE
+template <typename B>
+void displayTask(void)
+{
+  typedef typename B::Display Display;
+
+  if constexpr (Display::asyncFlush)
+  {
+    // Previous frame is still being sent, skip this one rather than wait
+    if (Display::displayBusy() || Display::rendering()) return;
+  }
+  // Only redraw when something shown has changed
+  if (!displayDue()) return;
+
+  PROFILE_START(PROFILE_RENDER);
+  Display::firstPage();
+  Display::render();
+  PROFILE_END(PROFILE_RENDER);
+
+  // Update screen
+  PROFILE_START(PROFILE_FLUSH);
+  if constexpr (Display::asyncFlush)
+  {
+    // Further pages are rendered by displayFlushTask
+    Display::displayAsync();
+  }
+  else
+  {
+    Display::display();
+    while (Display::nextPage())
+    {
+      Display::render();
+      Display::display();
+    }
+  }
+  PROFILE_END(PROFILE_FLUSH);
+}
+
+// Compare what is shown against the current values, with a maximum latency
+// and a reduced rate while baking
+bool displayDue(void)
+{
+  displaySnapshot_t snapshot;
+
+  snapshot.temperature = temperatureTenths(input);
+  snapshot.state = reflowState;
+  snapshot.profile = reflowProfile;
+  snapshot.fault = fault & SENSOR_FAULT_MASK;
+  snapshot.plotCount = 0;
+  snapshot.plotTop = 0;
+  snapshot.plotBottom = 0;
+  snapshot.plotSpan = plotSpan;
+  if constexpr (Board::hasPlot)
+  {
+    if (plotCount != 0)
+    {
+      snapshot.plotCount = plotCount;
+      snapshot.plotTop = plotTop[plotCount - 1];
+      snapshot.plotBottom = plotBottom[plotCount - 1];
+    }
+  }
+
+  unsigned long elapsed = currentTime - displayTime;
+  bool changed = memcmp(&snapshot, &displayShown, sizeof(snapshot)) != 0;
+  // Measured from the last full frame, changes keep resetting elapsed
+  bool refresh = DISPLAY_LATENCY_MAX && ((currentTime - displayRefreshTime) >= DISPLAY_LATENCY_MAX);
+
+  // State changes are always shown right away
+  if ((reflowState == REFLOW_STATE_BAKE) && (snapshot.state == displayShown.state) &&
+      (elapsed < DISPLAY_BAKE_PERIOD))
+  {
+    return false;
+  }
+  if (!changed && !refresh)
+  {
+    return false;
+  }
+
+  displayShown = snapshot;
+  displayTime = currentTime;
+  if (refresh)
+  {
+    displayRefreshTime = currentTime;
+    // A segment whose new content matches the old CRC is only sent here
+    Board::Display::invalidate();
+  }
+
+  return true;
+}
+
+#if OLED_ASYNC_FLUSH
+// Hand over the next chunk of an ongoing display flush, then render the
+// next page once the current one has left the bus
+template <typename B>
+void displayFlushTask(void)
+{
+  typedef typename B::Display Display;
+
+  if constexpr (Display::asyncFlush)
+  {
+    if (!Display::displayBusy() && Display::nextPage())
+    {
+      Display::render();
+      Display::displayAsync();
+    }
+  }
+}
+#endif
+
+template <typename B>
+switch_t readSwitch(void)
+{
+  if constexpr (B::switchDecoder == SWITCH_DECODER_LADDER)
+  {
+    int switchAdcValue = 0;
+    // Analog multiplexing switch
+    switchAdcValue = analogRead(B::switchPin);
+
+    // Add some allowance (+10 ADC step) as ADC reading might be off a little
+    // due to 3V3 deviation and also resistor value tolerance
+    if (switchAdcValue >= 1000) return SWITCH_NONE;
+    if (switchAdcValue <= 10) return SWITCH_1;
+    if (switchAdcValue <= 522) return SWITCH_2;
+  }
+  else
+  {
+    // Switch connected directly to individual separate pins
+    if (digitalRead(B::switchStartStopPin) == LOW) return SWITCH_1;
+    if (digitalRead(B::switchLfPbPin) == LOW) return SWITCH_2;
+  }
 
   return SWITCH_NONE;
 }
+
+// Timestamp a change of the switch level, from the pin change ISR or the
+// ladder poll
+void switchSample(unsigned long time)
+{
+  switch_t level = readSwitch<Board>();
+
+  if (level == switchLevel) return;
+  switchLevel = level;
+  switchEdgeTime = time;
+  switchEdge = true;
+}
+
+thermocoupleSample_t readThermocouple(unsigned char channel)
+{
+  thermocoupleSample_t sample;
+  int32_t temp24;
+
+  SPI.beginTransaction(SPISettings(SENSOR_SPI_CLOCK, MSBFIRST, SPI_MODE1));
+  digitalWrite(thermocoupleCSPins[channel], LOW);
+  // Register address auto-increments from LTCBH through to SR
+  SPI.transfer(MAX31856_LTCBH_REG);
+  temp24 = SPI.transfer(0);
+  temp24 <<= 8;
+  temp24 |= SPI.transfer(0);
+  temp24 <<= 8;
+  temp24 |= SPI.transfer(0);
+  sample.fault = SPI.transfer(0);
+  digitalWrite(thermocoupleCSPins[channel], HIGH);
+  SPI.endTransaction();
+
+  // Sign extend the 19-bit value left justified in 24 bits
+  if (temp24 & 0x800000) temp24 |= 0xFF000000;
+  sample.temperature = temp24 >> 5;
+
+  return sample;
+}
+
+void writeThermocouple(unsigned char channel, uint8_t address, uint8_t value)
+{
+  SPI.beginTransaction(SPISettings(SENSOR_SPI_CLOCK, MSBFIRST, SPI_MODE1));
+  digitalWrite(thermocoupleCSPins[channel], LOW);
+  SPI.transfer(address | 0x80);
+  SPI.transfer(value);
+  digitalWrite(thermocoupleCSPins[channel], HIGH);
+  SPI.endTransaction();
+}
+
+// Channel contributes to the control input
+bool sensorInInput(unsigned char channel)
+{
+  if (sensorInput == SENSOR_INPUT_CHANNEL) return channel == sensorInputChannel;
+  if (sensorInput == SENSOR_INPUT_AVERAGE) return pgm_read_byte(&sensorWeights[channel]) != 0;
+  return true;
+}
+
+// Control input from the last round over the channels selected by
+// sensorInput, fault is set from the channels it could not do without
+int32_t sensorCombine(void)
+{
+  int32_t value = 0;
+  int32_t faulty = 0;
+  unsigned int weights = 0;
+  uint8_t faults = 0;
+  bool valid = false;
+
+  for (unsigned char channel = 0; channel < SENSOR_CHANNELS; channel++)
+  {
+    int32_t temperature = sensorTemperature[channel];
+    uint8_t weight = pgm_read_byte(&sensorWeights[channel]);
+
+    if (!sensorInInput(channel)) continue;
+    if (sensorFault[channel] & SENSOR_FAULT_MASK)
+    {
+      faults |= sensorFault[channel];
+      faulty = temperature;
+      continue;
+    }
+    switch (sensorInput)
+    {
+      case SENSOR_INPUT_MIN:
+        if (!valid || (temperature < value)) value = temperature;
+        break;
+
+      case SENSOR_INPUT_MAX:
+        if (!valid || (temperature > value)) value = temperature;
+        break;
+
+      case SENSOR_INPUT_AVERAGE:
+        value += temperature * weight;
+        weights += weight;
+        break;
+
+      default:
+        value = temperature;
+        break;
+    }
+    valid = true;
+  }
+
+  if (!valid)
+  {
+    fault = faults;
+    return faulty;
+  }
+  fault = SENSOR_FAULT_TOLERANT ? 0 : faults;
+  if (sensorInput == SENSOR_INPUT_AVERAGE) value /= (int32_t)weights;
+
+  return value;
+}
+
+// Median and IIR stages on raw samples (LSB = 1/128 degree Celsius)
+int32_t sensorFilter(int32_t raw)
+{
+#if SENSOR_MEDIAN
+  int32_t sorted[SENSOR_MEDIAN];
+  unsigned char index;
+
+  if (!sensorPrimed)
+  {
+    for (index = 0; index < SENSOR_MEDIAN; index++)
+    {
+      sensorHistory[index] = raw;
+    }
+  }
+  sensorHistory[sensorHistoryIndex] = raw;
+  if (++sensorHistoryIndex >= SENSOR_MEDIAN) sensorHistoryIndex = 0;
+
+  // Insertion sort, a handful of elements
+  for (index = 0; index < SENSOR_MEDIAN; index++)
+  {
+    int32_t value = sensorHistory[index];
+    unsigned char position = index;
+
+    while ((position > 0) && (sorted[position - 1] > value))
+    {
+      sorted[position] = sorted[position - 1];
+      position--;
+    }
+    sorted[position] = value;
+  }
+  raw = sorted[SENSOR_MEDIAN / 2];
+#endif
+#if SENSOR_IIR_SHIFT
+  // Accumulator holds the output scaled by 2^SENSOR_IIR_SHIFT
+  if (!sensorPrimed)
+  {
+    sensorAccumulator = raw << SENSOR_IIR_SHIFT;
+  }
+  sensorAccumulator += raw - (sensorAccumulator >> SENSOR_IIR_SHIFT);
+  raw = sensorAccumulator >> SENSOR_IIR_SHIFT;
+#endif
+#if SENSOR_MEDIAN || SENSOR_IIR_SHIFT
+  sensorPrimed = true;
+#endif
+
+  return raw;
+}
+
+// Temperature rounded to tenths of degree as shown
+int32_t temperatureTenths(pidValue_t value)
+{
+#if PID_FIXED_POINT
+  return ((value * 10) + (1 << (PID_VALUE_SHIFT - 1))) >> PID_VALUE_SHIFT;
+#else
+  return lround(value * 10);
+#endif
+}
+
+// Render a temperature in tenths of degree into text without going through
+// printFloat(), returns the number of characters
+unsigned char formatTemperature(char *text, pidValue_t value)
+{
+  return formatTenths(text, temperatureTenths(value));
+}
+
+unsigned char formatTenths(char *text, int32_t tenths)
+{
+  // 16-bit divisions are much cheaper on AVR, thermocouples stay far below
+  uint16_t magnitude = min((tenths < 0) ? -tenths : tenths, (int32_t)0xFFFF);
+  char *ptr = text + TEMPERATURE_TEXT_SIZE - 1;
+  unsigned char length;
+
+  *ptr = '\0';
+  *--ptr = '0' + (magnitude % 10);
+  *--ptr = '.';
+  magnitude /= 10;
+  do
+  {
+    *--ptr = '0' + (magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0);
+  if (tenths < 0)
+  {
+    *--ptr = '-';
+  }
+
+  length = text + TEMPERATURE_TEXT_SIZE - 1 - ptr;
+  memmove(text, ptr, length + 1);
+
+  return length;
+}
+
+void printTemperature(Print &out, pidValue_t value)
+{
+  char text[TEMPERATURE_TEXT_SIZE];
+
+  formatTemperature(text, value);
+  out.print(text);
+}
+
+template <typename B>
+void fanBegin(void)
+{
+  if constexpr (B::hasFan)
+  {
+    digitalWrite(B::fanPin, LOW);
+    pinMode(B::fanPin, OUTPUT);
+  }
+}
+
+// Fan time proportioning, from the Timer1 ISR
+template <typename B>
+inline void fanUpdate(void)
+{
+  if constexpr (B::hasFan)
+  {
+    if (++fanWindowCounter >= FAN_WINDOW_SIZE) fanWindowCounter = 0;
+    if (fanDuty > fanWindowCounter) digitalWrite(B::fanPin, HIGH);
+    else digitalWrite(B::fanPin, LOW);
+  }
+}
+
+// SSR and fan time proportioning, every millisecond
+ISR(TIMER1_COMPA_vect)
+{
+  fanUpdate<Board>();
+#if SENSOR_FAULT_INTERRUPT
+  // Switched off by the pin change ISR, until the main loop has looked
+  if (sensorTrip) return;
+#endif
+#if SSR_BURST_FIRE
+  // Decide once per mains half-cycle, a zero-cross SSR switches at the next
+  // zero crossing. On half-cycles are spread evenly across the window.
+  if (++ssrWindowCounter < SSR_HALF_CYCLE) return;
+  ssrWindowCounter = 0;
+
+  ssrAccumulator += ssrDuty;
+  if (ssrAccumulator >= windowSize)
+  {
+    ssrAccumulator -= windowSize;
+    digitalWrite(ssrPin, HIGH);
+  }
+  else
+  {
+    digitalWrite(ssrPin, LOW);
+  }
+#else
+  if (++ssrWindowCounter >= windowSize)
+  {
+    // Time to shift the Relay Window
+    ssrWindowCounter = 0;
+  }
+  if (ssrDuty > ssrWindowCounter) digitalWrite(ssrPin, HIGH);
+  else digitalWrite(ssrPin, LOW);
+#endif
+}
+
+// Unmask a pin change source of PIN_CHANGE_vect
+void pinChangeEnable(uint8_t pin)
+{
+  *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+  // Drop a change latched before
+  PIN_CHANGE_FLAGS = _BV(digitalPinToPCICRbit(pin));
+  *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+}
+
+// Switch and thermocouple FAULT pin changes, inlined into the ISR
+template <typename B>
+inline void pinChange(void)
+{
+  if constexpr (B::hasPinChange)
+  {
+    static_assert((digitalPinToPCICRbit(B::switchStartStopPin) == PIN_CHANGE_PORT) &&
+                  (digitalPinToPCICRbit(B::switchLfPbPin) == PIN_CHANGE_PORT) &&
+                  (digitalPinToPCICRbit(B::thermocoupleFaultPin) == PIN_CHANGE_PORT),
+                  "Pin changes share PIN_CHANGE_vect");
+#if SENSOR_FAULT_INTERRUPT
+    static uint8_t faultLevel = HIGH;
+    uint8_t level = digitalRead(B::thermocoupleFaultPin);
+
+    // FAULT falls when a channel of the control input reports a fault, other
+    // pin changes leave the SSR alone
+    if ((level == LOW) && (faultLevel == HIGH))
+    {
+      // SSR off now, the main loop decides whether to enter the error state
+      digitalWrite(ssrPin, LOW);
+      ssrDuty = 0;
+      sensorTrip = true;
+    }
+    faultLevel = level;
+#endif
+    switchSample(millis());
+  }
+}
+
+// Never unmasked on boards without pin change sources
+ISR(PIN_CHANGE_vect)
+{
+  pinChange<Board>();
+}
+
+// Common start of a profile or tune run
+void runStart(void)
+{
+#if PROFILING
+  // Collect statistics for this run only
+  profileReset();
+#endif
+  // Send header for CSV file
+  if (telemetryMode == TELEMETRY_CSV)
+  {
+    telemetry.beginRecord();
+    telemetry.print(F("Time,Setpoint,Input,Raw,Output,Dropped"));
+    // Raw is the only channel on single probe ovens
+    for (unsigned char channel = 0; (SENSOR_CHANNELS > 1) && (channel < SENSOR_CHANNELS); channel++)
+    {
+      telemetry.print(F(",T"));
+      telemetry.print(channel);
+    }
+    telemetry.println();
+    telemetry.endRecord();
+  }
+  telemetryDecimationCount = 0;
+  // Intialize seconds timer for serial debug information
+  timerSeconds = 0;
+
+  // Plot covers the new run only
+  if constexpr (Board::hasPlot) plotReset();
+
+  // Initialize PID control window starting time
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    ssrWindowCounter = 0;
+  }
+  if constexpr (Board::hasFan) fanStart();
+#if RUN_LOG
+  runLogStart();
+#endif
+}
+
+void fanStart(void)
+{
+  fanLast = TEMPERATURE_Q4(input);
+  fanRateAccumulator = 0;
+  fanIntegral = 0;
+}
+
+// Fan duty for the PID sample just taken: PI on the cool-down rate during
+// the cool stage, fixed circulation while baking, off otherwise. The fan can
+// only speed cooling up, passive cooling above the target is left alone.
+unsigned int fanControl(void)
+{
+  int16_t temperature = TEMPERATURE_Q4(input);
+  int32_t error;
+  int32_t level;
+
+  fanRateAccumulator += (fanLast - temperature) - (fanRateAccumulator >> FAN_RATE_SHIFT);
+  fanLast = temperature;
+
+  if (reflowState == REFLOW_STATE_BAKE)
+  {
+    fanIntegral = 0;
+    return FAN_DUTY(min(FAN_BAKE_DUTY, FAN_DUTY_LIMIT));
+  }
+  // Also speeds up cooling down to the batch re-arm temperature
+  if (((reflowState != REFLOW_STATE_COOL) &&
+       ((reflowState != REFLOW_STATE_REARM) || (input <= setpoint))) ||
+      (FAN_COOL_RATE_Q4 <= 0))
+  {
+    fanIntegral = 0;
+    return 0;
+  }
+
+  // Rate error in 1/16 degree Celsius per second, duty % in Q.8
+  error = FAN_COOL_RATE_Q4 - (fanRateAccumulator >> FAN_RATE_SHIFT);
+  fanIntegral += (int32_t)FAN_KI * 16 * error;
+  fanIntegral = constrain(fanIntegral, 0, (int32_t)FAN_DUTY_LIMIT << 8);
+  level = fanIntegral + (int32_t)FAN_KP * 16 * error;
+  level = constrain(level, 0, (int32_t)FAN_DUTY_LIMIT << 8);
+
+  return (unsigned int)((level * FAN_WINDOW_SIZE) / (100L << 8));
+}
+
+void runComplete(void)
+{
+  // Retrieve current time for buzzer usage
+  buzzerPeriod = currentTime + 1000;
+  // Turn on buzzer to indicate completion
+  digitalWrite(buzzerPin, HIGH);
+  // Turn off reflow process
+  reflowStatus = REFLOW_STATUS_OFF;
+  // Proceed to reflow Completion state
+  reflowState = REFLOW_STATE_COMPLETE;
+#if PROFILING
+  // Report loop timing of the completed run
+  profileDump();
+#endif
+  if (batchActive) batchRunDone();
+}
+
+// Run the selected profile from the current oven temperature
+void profileStart(void)
+{
+  runStart();
+  // Ramp segments start from the current oven temperature
+  setpoint = input;
+  // Tell the PID to range between 0 and the full window size
+  reflowOvenPID.SetOutputLimits(0, windowSize);
+  reflowOvenPID.SetSampleTime(PID_SAMPLE_TIME);
+  // Turn the PID on
+  reflowOvenPID.SetMode(AUTOMATIC);
+  reflowStatus = REFLOW_STATUS_ON;
+#if THERMAL_MODEL
+  // Fit a fresh oven model on this run's preheat ramp
+  modelStart();
+#endif
+  // Proceed to first segment of chosen profile
+  segmentIndex = pgm_read_byte(&reflowProfiles[reflowProfile].first);
+  segmentEnd = segmentIndex + profileSegmentCount();
+  segmentEnter(segmentIndex);
+}
+
+// Queue loaded while idle, statistics cover the batch
+void batchStart(void)
+{
+  batchActive = true;
+  batchRuns = 0;
+  batchRunTime = 0;
+  batchWaitTime = 0;
+  batchRearm();
+}
+
+// Hold the oven at the re-arm temperature until the next run is confirmed
+void batchRearm(void)
+{
+  pidGains_t gains = settings.gains[PID_GAINS_BAKE];
+
+  batchMark = currentTime;
+  batchConfirmed = false;
+  setpoint = TEMPERATURE(BATCH_REARM_TEMPERATURE);
+  reflowOvenPID.SetTunings(gains.kp, gains.ki, gains.kd);
+  reflowOvenPID.SetOutputLimits(0, windowSize);
+  reflowOvenPID.SetSampleTime(PID_SAMPLE_TIME);
+  reflowOvenPID.SetMode(AUTOMATIC);
+  reflowStatus = REFLOW_STATUS_ON;
+  reflowState = REFLOW_STATE_REARM;
+}
+
+void batchNext(void)
+{
+  batchLastWait = (currentTime - batchMark) / 1000;
+  batchWaitTime += batchLastWait;
+  // Not a selection, the settings keep the operator's profile
+  reflowProfile = batchQueue[0];
+  memmove(&batchQueue[0], &batchQueue[1], --batchCount * sizeof(batchQueue[0]));
+  batchMark = currentTime;
+  profileStart();
+}
+
+// Statistics of the run just completed, the batch ends with the queue
+void batchRunDone(void)
+{
+  unsigned int runTime = (currentTime - batchMark) / 1000;
+
+  batchRuns++;
+  batchRunTime += runTime;
+  telemetry.beginRecord();
+  telemetry.print(F("run,"));
+  telemetry.print(batchRuns);
+  telemetry.print(F(","));
+  printProfileName(telemetry);
+  telemetry.print(F(","));
+  telemetry.print(runTime);
+  telemetry.print(F(","));
+  telemetry.println(batchLastWait);
+  telemetry.endRecord();
+  if (batchCount == 0) batchEnd();
+}
+
+// Report the batch and release the oven
+void batchEnd(void)
+{
+  batchActive = false;
+  batchCount = 0;
+  telemetry.beginRecord();
+  printBatch(telemetry);
+  telemetry.endRecord();
+  if (reflowState == REFLOW_STATE_REARM)
+  {
+    reflowStatus = REFLOW_STATUS_OFF;
+    reflowState = REFLOW_STATE_IDLE;
+  }
+}
+
+void printBatch(Print &out)
+{
+  out.print(F("batch,"));
+  out.print(batchCount);
+  out.print(F(","));
+  out.print(batchRuns);
+  out.print(F(","));
+  out.print(batchRunTime);
+  out.print(F(","));
+  out.println(batchWaitTime);
+}
+
+// Load a segment of the running profile and apply its gains and target
+void segmentEnter(unsigned char index)
+{
+  pidGains_t gains;
+
+  if (reflowProfile == REFLOW_PROFILE_CUSTOM)
+  {
+    segment = settings.segments[index];
+  }
+  else
+  {
+    memcpy_P(&segment, &reflowSegments[index], sizeof(segment));
+  }
+  gains = settings.gains[segment.gains];
+  reflowOvenPID.SetTunings(gains.kp, gains.ki, gains.kd);
+
+  if (segment.exit == SEGMENT_EXIT_RAMP)
+  {
+    // Ramp from the current setpoint
+    timerSegment = currentTime + SEGMENT_RAMP_PERIOD;
+    segmentRemainder = 0;
+  }
+  else
+  {
+    setpoint = TEMPERATURE(segment.target);
+    timerSegment = currentTime + (unsigned long)segment.parameter * 1000;
+  }
+#if THERMAL_MODEL
+  // Preheat ramp completed
+  if ((reflowState == REFLOW_STATE_PREHEAT) && (segment.stage != REFLOW_STATE_PREHEAT))
+  {
+    modelFit();
+  }
+#endif
+  reflowState = segment.stage;
+}
+
+// Evaluate exit condition of the active segment, advancing ramps
+bool segmentDone(void)
+{
+  switch (segment.exit)
+  {
+    case SEGMENT_EXIT_ABOVE:
+#if THERMAL_MODEL
+      // Cut heating early on the predicted coast-up instead of a margin
+      if (modelPhase == MODEL_VALID) return modelPeakReached();
+#endif
+      return input >= TEMPERATURE(segment.target - segment.parameter);
+
+    case SEGMENT_EXIT_BELOW:
+      return input <= TEMPERATURE(segment.target + segment.parameter);
+
+    case SEGMENT_EXIT_RAMP:
+      if ((long)(currentTime - timerSegment) >= 0)
+      {
+        pidValue_t step;
+
+        // Whole 1/16 degree steps covered so far, the rest carries over
+        segmentRemainder += (int32_t)segment.parameter * 16 * (SEGMENT_RAMP_PERIOD / 1000);
+        step = TEMPERATURE_FROM_Q4(segmentRemainder / 3600);
+        segmentRemainder %= 3600;
+        timerSegment += SEGMENT_RAMP_PERIOD;
+        // Ramp in either direction towards the target
+        if (setpoint < TEMPERATURE(segment.target))
+        {
+          setpoint += step;
+          return setpoint >= TEMPERATURE(segment.target);
+        }
+        setpoint -= step;
+        return setpoint <= TEMPERATURE(segment.target);
+      }
+      return false;
+
+    case SEGMENT_EXIT_HOLD:
+      return (long)(currentTime - timerSegment) >= 0;
+
+    default:
+      return false;
+  }
+}
+
+// Relay auto-tune over all tune points, the oven must be idle
+void tuneStart(void)
+{
+  runStart();
+  // Output is driven by the relay, the PID restarts with the next profile
+  reflowOvenPID.SetMode(MANUAL);
+#if THERMAL_MODEL
+  // No feed-forward from a previous fit
+  modelPhase = MODEL_IDLE;
+#endif
+  tuneSampleTime = currentTime;
+  reflowStatus = REFLOW_STATUS_ON;
+  reflowState = REFLOW_STATE_TUNE;
+  tunePointEnter(0);
+}
+
+void tunePointEnter(unsigned char index)
+{
+  tuneIndex = index;
+  memcpy_P(&tunePoint, &tunePoints[index], sizeof(tunePoint));
+  setpoint = TEMPERATURE(tunePoint.temperature);
+  tuneEdges = 0;
+  tunePeriodSum = 0;
+  tuneSwingSum = 0;
+  tuneTimeout = currentTime + TUNE_TIMEOUT * 1000UL;
+  // Points are ascending, heat up to the first crossing
+  tuneRelay(true);
+}
+
+void tuneRelay(bool heating)
+{
+  tuneHeating = heating;
+  output = heating ? windowSize : 0;
+  // Switch now rather than on the next PID sample
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    ssrDuty = (unsigned int)output;
+  }
+}
+
+// Called every pass, each heating edge closes an oscillation
+void tuneStep(void)
+{
+  int16_t temperature = TEMPERATURE_Q4(input);
+  int16_t target = tunePoint.temperature * 16;
+
+  if ((long)(currentTime - tuneTimeout) >= 0)
+  {
+    // Oven cannot reach or oscillate around the point
+    telemetry.beginRecord();
+    telemetry.println(F("tune,timeout"));
+    telemetry.endRecord();
+    reflowStatus = REFLOW_STATUS_OFF;
+    reflowState = REFLOW_STATE_IDLE;
+    return;
+  }
+
+  if (temperature > tuneMax) tuneMax = temperature;
+  if (temperature < tuneMin) tuneMin = temperature;
+
+  if (tuneHeating)
+  {
+    if (temperature >= target + TUNE_HYSTERESIS * 16)
+    {
+      tuneRelay(false);
+    }
+    return;
+  }
+  if (temperature > target - TUNE_HYSTERESIS * 16)
+  {
+    return;
+  }
+  tuneRelay(true);
+
+  // The first oscillation still carries the approach, discard it
+  if (tuneEdges >= 2)
+  {
+    tunePeriodSum += currentTime - tuneCycleStart;
+    tuneSwingSum += tuneMax - tuneMin;
+  }
+  tuneCycleStart = currentTime;
+  tuneMax = temperature;
+  tuneMin = temperature;
+  if (++tuneEdges < TUNE_CYCLES + 2)
+  {
+    return;
+  }
+
+  pidGains_t gains;
+
+  tuneGains(&gains);
+  // Kept even if a later point is cancelled, stored once the oven is off
+  settings.gains[tunePoint.gains] = gains;
+  settingsChanged();
+  telemetry.beginRecord();
+  telemetry.print(F("tune,"));
+  telemetry.print((unsigned char)tunePoint.gains);
+  telemetry.print(F(","));
+  printGains(telemetry, gains);
+  telemetry.endRecord();
+
+  if (tuneIndex + 1 < TUNE_POINT_COUNT)
+  {
+    tunePointEnter(tuneIndex + 1);
+  }
+  else
+  {
+    runComplete();
+  }
+}
+
+// Telemetry tick while tuning
+bool tuneSample(void)
+{
+  if ((long)(currentTime - tuneSampleTime) < 0)
+  {
+    return false;
+  }
+  tuneSampleTime += PID_SAMPLE_TIME;
+  return true;
+}
+
+// Tyreus-Luyben gains from the averaged relay oscillation
+void tuneGains(pidGains_t *gains)
+{
+  uint32_t period = tunePeriodSum / TUNE_CYCLES;
+  int32_t swing = tuneSwingSum / (2 * TUNE_CYCLES);
+  int32_t hysteresis = TUNE_HYSTERESIS * 16;
+  // Relay amplitude
+  int32_t relay = windowSize / 2;
+  // Oscillation amplitude corrected for the relay hysteresis
+  int32_t amplitude = swing;
+
+  if (swing > hysteresis)
+  {
+    amplitude = tuneSqrt((uint32_t)(swing * swing - hysteresis * hysteresis));
+  }
+  if (amplitude < 1) amplitude = 1;
+
+#if PID_FIXED_POINT
+  // Saturated to the positive range of the Q16.16 gains
+  gains->kp = min(mulDiv(TUNE_KP, relay, amplitude), 0x7FFFFFFFUL);
+  // Ti = 2.2 Tu, Td = Tu / 6.3
+  gains->ki = min(mulDiv(gains->kp, 10000, period * 22), 0x7FFFFFFFUL);
+  gains->kd = min(mulDiv(gains->kp, period, 6300), 0x7FFFFFFFUL);
+#else
+  gains->kp = TUNE_KP * relay / amplitude;
+  // Ti = 2.2 Tu, Td = Tu / 6.3
+  gains->ki = gains->kp * 1000 / (2.2 * period);
+  gains->kd = gains->kp * period / 6300;
+#endif
+}
+
+uint16_t tuneSqrt(uint32_t value)
+{
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+
+  while (bit > value) bit >>= 2;
+  while (bit != 0)
+  {
+    if (value >= root + bit)
+    {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint16_t)root;
+}
+
+void printProfileName(Print &out, reflowProfile_t profile)
+{
+  char name[sizeof(reflowProfiles[0].name)];
+
+  memcpy_P(name, reflowProfiles[profile].name, sizeof(name));
+  out.print(name);
+}
+
+unsigned char profileSegmentCount(void)
+{
+  if (reflowProfile == REFLOW_PROFILE_CUSTOM)
+  {
+    return settings.segmentCount;
+  }
+  return pgm_read_byte(&reflowProfiles[reflowProfile].count);
+}
+
+// Restore the newest valid settings record, or defaults
+void settingsLoad(void)
+{
+  bool found = false;
+
+  for (unsigned char slot = 0; slot < SETTINGS_SLOTS; slot++)
+  {
+    int address = slot * SETTINGS_SLOT_SIZE;
+    uint16_t sequence = EEPROM.read(address) | (EEPROM.read(address + 1) << 8);
+
+    // Only verify records newer than the best so far (rollover safe)
+    if (found && ((int16_t)(sequence - settings.sequence) <= 0))
+    {
+      continue;
+    }
+
+    uint16_t crc = 0xFFFF;
+    for (unsigned char offset = 0; offset < sizeof(settings_t); offset++)
+    {
+      crc = _crc_xmodem_update(crc, EEPROM.read(address + offset));
+    }
+    address += sizeof(settings_t);
+    if ((crc >> 8) != EEPROM.read(address) || (crc & 0xFF) != EEPROM.read(address + 1))
+    {
+      continue;
+    }
+
+    settings_t record;
+    EEPROM.get(slot * SETTINGS_SLOT_SIZE, record);
+    if ((record.version != SETTINGS_VERSION) || (record.profile >= REFLOW_PROFILE_COUNT) ||
+        (record.segmentCount > CUSTOM_SEGMENT_MAX))
+    {
+      continue;
+    }
+    settings = record;
+    settingsSlot = slot;
+    found = true;
+  }
+
+  if (!found)
+  {
+    // First start, keep the profile selected by earlier firmware if any
+    unsigned char value = EEPROM.read(PROFILE_TYPE_ADDRESS);
+
+    settings.sequence = 0;
+    settings.version = SETTINGS_VERSION;
+    settings.profile = (value < REFLOW_PROFILE_COUNT) ?
+                       static_cast<reflowProfile_t>(value) : REFLOW_PROFILE_LEADFREE;
+    memcpy_P(settings.gains, pidGains, sizeof(settings.gains));
+    settings.segmentCount = 0;
+    // First record goes to slot 0
+    settingsSlot = SETTINGS_SLOTS - 1;
+    settingsChanged();
+  }
+
+  // Custom segments must reference known stages and gain sets
+  for (unsigned char index = 0; index < settings.segmentCount; index++)
+  {
+    if (!segmentValid(settings.segments[index]))
+    {
+      settings.segmentCount = 0;
+      break;
+    }
+  }
+}
+
+bool segmentValid(const reflowSegment_t &custom)
+{
+  if ((custom.gains >= PID_GAINS_COUNT) || (custom.exit > SEGMENT_EXIT_NEVER))
+  {
+    return false;
+  }
+  // Only process stages, the executor owns the other states
+  return ((custom.stage >= REFLOW_STATE_PREHEAT) && (custom.stage <= REFLOW_STATE_COOL)) ||
+         (custom.stage == REFLOW_STATE_BAKE);
+}
+
+// Only valid while idle, persisted through the settings store
+void selectProfile(reflowProfile_t profile)
+{
+  reflowProfile = profile;
+  settings.profile = reflowProfile;
+  settingsChanged();
+}
+
+// Run one command line, false for unknown or rejected commands
+//   start, stop                  same as switch 1 when idle or running, start
+//                                confirms and stop ends a waiting batch
+//   profile <n>                  select profile while idle
+//   segment <i> <stage> <gains> <exit> <target> <parameter>
+//                                set custom segment i, the profile ends after it
+//   gains <set> [<kp> <ki> <kd>] read or write a PID gain set
+//   tune                         relay auto-tune of all gain sets from idle,
+//                                reports tune,<set>,<kp>,<ki>,<kd> per set
+//   status                       state,profile,setpoint,input,output,fault,dropped
+//   input [ch <n>|min|max|avg]   read or select the control input, reports
+//                                input,<mode>,<channel> then <temperature>,<fault>
+//                                of every channel
+//   batch [<profile>...]         queue profile runs, from idle or on top of a
+//                                running batch. Between runs the oven is held
+//                                at the re-arm temperature, the next run starts
+//                                on start or switch 1 once there. Reports
+//                                batch,<queued>,<runs>,<run s>,<wait s>, and
+//                                run,<n>,<profile>,<run s>,<wait s> per run
+//   log [<run>|erase]            run log (RUN_LOG only): log,<runs>,<page>,<pages>,<dropped>,
+//                                download of a run as log,<run>,<profile>,<result>,
+//                                <record size>,<bytes> followed by the raw pages,
+//                                or erase of the whole flash while idle
+//   csv, binary                  telemetry format
+//   model                        phase,lag,loss,gain (THERMAL_MODEL only)
+//   stats                        timing statistics (PROFILING only)
+bool commandExecute(char *line)
+{
+  char *cursor = line;
+  char *command = commandToken(&cursor);
+  long value;
+
+  if (strcmp_P(command, PSTR("start")) == 0)
+  {
+    if ((reflowState != REFLOW_STATE_REARM) &&
+        ((reflowState != REFLOW_STATE_IDLE) || (reflowStatus == REFLOW_STATUS_ON) ||
+         (profileSegmentCount() == 0)))
+    {
+      return false;
+    }
+    // Consumed by reflowTask on the next pass
+    switchStatus = SWITCH_1;
+  }
+  else if (strcmp_P(command, PSTR("tune")) == 0)
+  {
+    if ((reflowState != REFLOW_STATE_IDLE) || (reflowStatus == REFLOW_STATUS_ON))
+    {
+      return false;
+    }
+    tuneStart();
+  }
+  else if (strcmp_P(command, PSTR("stop")) == 0)
+  {
+    if (reflowStatus != REFLOW_STATUS_ON)
+    {
+      return false;
+    }
+    if (reflowState == REFLOW_STATE_REARM)
+    {
+      batchEnd();
+    }
+    else
+    {
+      switchStatus = SWITCH_1;
+    }
+  }
+  else if (strcmp_P(command, PSTR("batch")) == 0)
+  {
+    unsigned char count = batchCount;
+
+    if (*cursor == '\0')
+    {
+      telemetry.beginRecord();
+      printBatch(telemetry);
+      telemetry.endRecord();
+      return true;
+    }
+    if (!batchActive && (reflowState != REFLOW_STATE_IDLE) && (reflowState != REFLOW_STATE_TOO_HOT))
+    {
+      return false;
+    }
+    // Queue is only extended if the whole line is valid
+    while (*cursor != '\0')
+    {
+      if (!commandNumber(&cursor, &value) || (value < 0) || (value >= REFLOW_PROFILE_COUNT) ||
+          ((value == REFLOW_PROFILE_CUSTOM) && (settings.segmentCount == 0)) ||
+          (count >= BATCH_QUEUE_SIZE))
+      {
+        return false;
+      }
+      batchQueue[count++] = static_cast<reflowProfile_t>(value);
+    }
+    batchCount = count;
+    if (!batchActive)
+    {
+      batchStart();
+    }
+  }
+  else if (strcmp_P(command, PSTR("profile")) == 0)
+  {
+    if (!commandNumber(&cursor, &value) || (value < 0) || (value >= REFLOW_PROFILE_COUNT) ||
+        (reflowState != REFLOW_STATE_IDLE))
+    {
+      return false;
+    }
+    selectProfile(static_cast<reflowProfile_t>(value));
+  }
+  else if (strcmp_P(command, PSTR("segment")) == 0)
+  {
+    reflowSegment_t custom;
+    long index;
+    long field[5];
+
+    if (!commandNumber(&cursor, &index) || (index < 0) || (index >= CUSTOM_SEGMENT_MAX) ||
+        (index > settings.segmentCount))
+    {
+      return false;
+    }
+    for (unsigned char i = 0; i < 5; i++)
+    {
+      if (!commandNumber(&cursor, &field[i]))
+      {
+        return false;
+      }
+    }
+    custom.stage = static_cast<reflowState_t>(field[0]);
+    custom.gains = static_cast<pidGainSet_t>(field[1]);
+    custom.exit = static_cast<segmentExit_t>(field[2]);
+    custom.target = field[3];
+    custom.parameter = field[4];
+    // Leave a running custom profile alone
+    if (!segmentValid(custom) ||
+        ((reflowStatus == REFLOW_STATUS_ON) && (reflowProfile == REFLOW_PROFILE_CUSTOM)))
+    {
+      return false;
+    }
+    settings.segments[index] = custom;
+    settings.segmentCount = index + 1;
+    settingsChanged();
+  }
+  else if (strcmp_P(command, PSTR("gains")) == 0)
+  {
+    pidGains_t gains;
+
+    if (!commandNumber(&cursor, &value) || (value < 0) || (value >= PID_GAINS_COUNT))
+    {
+      return false;
+    }
+    if (*cursor == '\0')
+    {
+      telemetry.beginRecord();
+      printGains(telemetry, settings.gains[value]);
+      telemetry.endRecord();
+      return true;
+    }
+    if (!commandGain(&cursor, &gains.kp) || !commandGain(&cursor, &gains.ki) ||
+        !commandGain(&cursor, &gains.kd))
+    {
+      return false;
+    }
+    // Applied from the next segment on
+    settings.gains[value] = gains;
+    settingsChanged();
+  }
+  else if (strcmp_P(command, PSTR("status")) == 0)
+  {
+    telemetry.beginRecord();
+    telemetry.print(reflowState);
+    telemetry.print(F(","));
+    telemetry.print(reflowProfile);
+    telemetry.print(F(","));
+    printTemperature(telemetry, setpoint);
+    telemetry.print(F(","));
+    printTemperature(telemetry, input);
+    telemetry.print(F(","));
+    telemetry.print(output);
+    telemetry.print(F(","));
+    telemetry.print(fault);
+    telemetry.print(F(","));
+    telemetry.println(telemetry.dropped);
+    telemetry.endRecord();
+    return true;
+  }
+  else if (strcmp_P(command, PSTR("input")) == 0)
+  {
+    char *mode = commandToken(&cursor);
+
+    if (*mode == '\0')
+    {
+      telemetry.beginRecord();
+      telemetry.print(F("input,"));
+      telemetry.print(sensorInput);
+      telemetry.print(F(","));
+      telemetry.print(sensorInputChannel);
+      for (unsigned char channel = 0; channel < SENSOR_CHANNELS; channel++)
+      {
+        telemetry.print(F(","));
+        printTemperature(telemetry, TEMPERATURE_RAW(sensorTemperature[channel]));
+        telemetry.print(F(","));
+        telemetry.print(sensorFault[channel]);
+      }
+      telemetry.println();
+      telemetry.endRecord();
+      return true;
+    }
+    if (strcmp_P(mode, PSTR("ch")) == 0)
+    {
+      if (!commandNumber(&cursor, &value) || (value < 0) || (value >= SENSOR_CHANNELS))
+      {
+        return false;
+      }
+      sensorInputChannel = value;
+      sensorInput = SENSOR_INPUT_CHANNEL;
+    }
+    else if (strcmp_P(mode, PSTR("min")) == 0)
+    {
+      sensorInput = SENSOR_INPUT_MIN;
+    }
+    else if (strcmp_P(mode, PSTR("max")) == 0)
+    {
+      sensorInput = SENSOR_INPUT_MAX;
+    }
+    else if (strcmp_P(mode, PSTR("avg")) == 0)
+    {
+      sensorInput = SENSOR_INPUT_AVERAGE;
+    }
+    else
+    {
+      return false;
+    }
+#if SENSOR_FAULT_INTERRUPT
+    sensorFaultMask();
+#endif
+  }
+#if RUN_LOG
+  else if (strcmp_P(command, PSTR("log")) == 0)
+  {
+    char *argument = commandToken(&cursor);
+
+    if (*argument == '\0')
+    {
+      telemetry.beginRecord();
+      runLogReport(telemetry);
+      telemetry.endRecord();
+      return true;
+    }
+    if (strcmp_P(argument, PSTR("erase")) == 0)
+    {
+      if ((reflowStatus == REFLOW_STATUS_ON) || runLogActive || runLogIndexPending ||
+          runLogPagePending || runLogResultPending || (runLogDumpAddress < runLogDumpEnd))
+      {
+        return false;
+      }
+      flashSelect(FLASH_WRITE_ENABLE);
+      flashDeselect();
+      flashSelect(FLASH_CHIP_ERASE);
+      flashDeselect();
+      runLogErasing = true;
+    }
+    else
+    {
+      cursor = argument;
+      return commandNumber(&cursor, &value) && (value >= 0) && (value <= 0xFFFF) &&
+             runLogDumpStart(value);
+    }
+  }
+#endif
+  else if (strcmp_P(command, PSTR("csv")) == 0)
+  {
+    telemetryMode = TELEMETRY_CSV;
+  }
+  else if (strcmp_P(command, PSTR("binary")) == 0)
+  {
+    telemetryMode = TELEMETRY_BINARY;
+  }
+#if THERMAL_MODEL
+  else if (strcmp_P(command, PSTR("model")) == 0)
+  {
+    telemetry.beginRecord();
+    telemetry.print(modelPhase);
+    telemetry.print(F(","));
+    telemetry.print(modelLag);
+    telemetry.print(F(","));
+    telemetry.print(modelLoss);
+    telemetry.print(F(","));
+    telemetry.println(modelGain);
+    telemetry.endRecord();
+    return true;
+  }
+#endif
+#if PROFILING
+  else if (strcmp_P(command, PSTR("stats")) == 0)
+  {
+    // Timing statistics on request
+    profileDump();
+    return true;
+  }
+#endif
+  else
+  {
+    return false;
+  }
+
+  telemetry.beginRecord();
+  telemetry.println(F("ok"));
+  telemetry.endRecord();
+  return true;
+}
+
+// Split the next space separated token off the line
+char *commandToken(char **cursor)
+{
+  char *token;
+
+  while (**cursor == ' ')
+  {
+    (*cursor)++;
+  }
+  token = *cursor;
+  while ((**cursor != ' ') && (**cursor != '\0'))
+  {
+    (*cursor)++;
+  }
+  if (**cursor == ' ')
+  {
+    *(*cursor)++ = '\0';
+  }
+
+  return token;
+}
+
+bool commandNumber(char **cursor, long *value)
+{
+  char *token = commandToken(cursor);
+  char *end;
+
+  *value = strtol(token, &end, 10);
+
+  return (*token != '\0') && (*end == '\0');
+}
+
+// Non-negative decimal gain with up to 4 fraction digits, no float parsing
+bool commandGain(char **cursor, pidGain_t *gain)
+{
+  char *token = commandToken(cursor);
+  char *end;
+  unsigned long integer = strtoul(token, &end, 10);
+  unsigned long fraction = 0;
+  unsigned long divisor = 1;
+
+  if ((end == token) || (*token == '-') || (integer > 32767))
+  {
+    return false;
+  }
+  if (*end == '.')
+  {
+    while ((*++end >= '0') && (*end <= '9'))
+    {
+      if (divisor < 10000)
+      {
+        fraction = fraction * 10 + (*end - '0');
+        divisor *= 10;
+      }
+    }
+  }
+  if (*end != '\0')
+  {
+    return false;
+  }
+#if PID_FIXED_POINT
+  *gain = (integer << 16) + ((fraction << 16) / divisor);
+#else
+  *gain = integer + (double)fraction / divisor;
+#endif
+
+  return true;
+}
+
+void printGain(Print &out, pidGain_t gain)
+{
+#if PID_FIXED_POINT
+  unsigned int fraction = ((uint32_t)(gain & 0xFFFF) * 10000) >> 16;
+
+  out.print(gain >> 16);
+  out.print(F("."));
+  // Four fraction digits with leading zeros
+  for (unsigned int digit = 1000; digit > 0; digit /= 10)
+  {
+    out.print((fraction / digit) % 10);
+  }
+#else
+  out.print(gain, 4);
+#endif
+}
+
+// One kp,ki,kd line
+void printGains(Print &out, const pidGains_t &gains)
+{
+  printGain(out, gains.kp);
+  out.print(F(","));
+  printGain(out, gains.ki);
+  out.print(F(","));
+  printGain(out, gains.kd);
+  out.println();
+}
+
+// Schedule a deferred write of the settings
+void settingsChanged(void)
+{
+  settingsDirty = true;
+  settingsChangeTime = millis();
+}
+
+void plotReset(void)
+{
+  plotCount = 0;
+  plotSpan = 1;
+}
+
+// Extend the current column or start a new one, merging columns 2:1 when
+// the run outgrows the screen
+void plotAdd(pidValue_t value)
+{
+  unsigned char row;
+
+  if (value <= TEMPERATURE(0))
+  {
+    row = PLOT_BOTTOM;
+  }
+  else if (value >= TEMPERATURE(250))
+  {
+    row = PLOT_TOP;
+  }
+  else
+  {
+    row = PLOT_BOTTOM - (unsigned char)((value * (PLOT_BOTTOM - PLOT_TOP)) / TEMPERATURE(250));
+  }
+
+  // A frame rendered page by page shows the columns latched in displayShown,
+  // they must stay as they are until it is complete
+  bool rendering = Board::Display::rendering();
+  // Just reset, drop the sample rather than overwrite a shown column
+  if (rendering && (plotCount < displayShown.plotCount)) return;
+
+  // Widen the last column instead of merging under a frame
+  if ((plotCount != 0) && (((long)(currentTime - plotColumnEnd) < 0) ||
+                           (rendering && (plotCount == PLOT_COLUMNS))))
+  {
+    if (row < plotTop[plotCount - 1]) plotTop[plotCount - 1] = row;
+    if (row > plotBottom[plotCount - 1]) plotBottom[plotCount - 1] = row;
+    return;
+  }
+
+  if (plotCount == 0)
+  {
+    plotColumnEnd = currentTime;
+  }
+  else if (plotCount == PLOT_COLUMNS)
+  {
+    for (unsigned char column = 0; column < (PLOT_COLUMNS / 2); column++)
+    {
+      plotTop[column] = min(plotTop[2 * column], plotTop[2 * column + 1]);
+      plotBottom[column] = max(plotBottom[2 * column], plotBottom[2 * column + 1]);
+    }
+    plotCount = PLOT_COLUMNS / 2;
+    plotSpan *= 2;
+  }
+  plotColumnEnd += (unsigned long)plotSpan * PLOT_PERIOD;
+  plotTop[plotCount] = row;
+  plotBottom[plotCount] = row;
+  plotCount++;
+}
+
+#if THERMAL_MODEL
+void modelStart(void)
+{
+  modelPhase = MODEL_LAG;
+  modelAmbient = TEMPERATURE_Q4(input);
+  modelLast = modelAmbient;
+  modelLag = 0;
+  modelSlope = 0;
+  modelWindows = 0;
+}
+
+// Called once per PID sample (1 s)
+void modelSample(void)
+{
+  int16_t temperature = TEMPERATURE_Q4(input);
+
+  // Smoothed rate for the coast-up prediction
+  modelSlope += (((int32_t)(temperature - modelLast) << 4) - modelSlope) >> 2;
+  modelLast = temperature;
+
+  switch (modelPhase)
+  {
+    case MODEL_LAG:
+      modelLag++;
+      if ((temperature - modelAmbient) >= (MODEL_RISE * 16))
+      {
+        modelPhase = MODEL_FIT;
+        modelSamples = 0;
+        modelDutySum = 0;
+        modelWindowStart = temperature;
+      }
+      break;
+
+    case MODEL_FIT:
+      modelDutySum += ssrDuty;
+      if (++modelSamples >= MODEL_WINDOW)
+      {
+        unsigned int duty = modelDutySum / MODEL_WINDOW;
+
+        // Only windows close to full power, slope normalized to full duty
+        if (((uint32_t)duty * 100) >= ((uint32_t)windowSize * MODEL_DUTY_MIN))
+        {
+          int32_t slope = ((int32_t)(temperature - modelWindowStart) * windowSize) / duty;
+          int16_t middle = (temperature + modelWindowStart) / 2;
+
+          if (modelWindows++ == 0)
+          {
+            modelSlopeFirst = slope;
+            modelTemperatureFirst = middle;
+          }
+          else
+          {
+            modelSlopeLast = slope;
+            modelTemperatureLast = middle;
+          }
+        }
+        modelSamples = 0;
+        modelDutySum = 0;
+        modelWindowStart = temperature;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+// The heating rate drops with the losses as the oven warms up, two windows
+// far enough apart give both the loss and the gain
+void modelFit(void)
+{
+  int16_t span = modelTemperatureLast - modelTemperatureFirst;
+
+  modelPhase = MODEL_IDLE;
+  if ((modelWindows < 2) || (span < (MODEL_SPAN_MIN * 16)))
+  {
+    return;
+  }
+
+  modelLoss = ((modelSlopeFirst - modelSlopeLast) << 16) / span;
+  if (modelLoss < 0) modelLoss = 0;
+  modelGain = modelSlopeFirst +
+              ((modelLoss * (modelTemperatureFirst - modelAmbient)) >> 16);
+  if (modelGain <= 0)
+  {
+    return;
+  }
+
+  modelPhase = MODEL_VALID;
+  // PID now corrects around the feed-forward in both directions
+  reflowOvenPID.SetOutputLimits(-(pidValue_t)windowSize, windowSize);
+}
+
+// Duty holding the setpoint and its ramp on setpoint tracking segments
+pidValue_t modelFeedForward(void)
+{
+  int32_t rate = 0;
+  int32_t duty;
+
+  if ((modelPhase != MODEL_VALID) ||
+      ((segment.exit != SEGMENT_EXIT_RAMP) && (segment.exit != SEGMENT_EXIT_HOLD) &&
+       (segment.exit != SEGMENT_EXIT_NEVER)))
+  {
+    return 0;
+  }
+
+  if (segment.exit == SEGMENT_EXIT_RAMP)
+  {
+    rate = ((int32_t)segment.parameter * 16 * MODEL_WINDOW) / 3600;
+    if (setpoint > TEMPERATURE(segment.target)) rate = -rate;
+  }
+  duty = rate + ((modelLoss * (TEMPERATURE_Q4(setpoint) - modelAmbient)) >> 16);
+  duty = (duty * (int32_t)windowSize) / modelGain;
+  if (duty < 0) duty = 0;
+  else if (duty > (int32_t)windowSize) duty = windowSize;
+
+  return duty;
+}
+
+// Temperature keeps rising for about the dead time once heating stops
+bool modelPeakReached(void)
+{
+  int32_t coast = (max(modelSlope, (int32_t)0) * modelLag) >> 4;
+
+  return (TEMPERATURE_Q4(input) + coast) >= ((int32_t)segment.target * 16);
+}
+#endif
+
+// Queue a telemetry record of the current PID sample
+void sendTelemetry(void)
+{
+  if (telemetryMode == TELEMETRY_BINARY)
+  {
+    sendTelemetryFrame();
+    return;
+  }
+
+  telemetry.beginRecord();
+  telemetry.print(timerSeconds);
+  telemetry.print(F(","));
+  printTemperature(telemetry, setpoint);
+  telemetry.print(F(","));
+  printTemperature(telemetry, input);
+  telemetry.print(F(","));
+  printTemperature(telemetry, inputRaw);
+  telemetry.print(F(","));
+  telemetry.print(output);
+  telemetry.print(F(","));
+  telemetry.print(telemetry.dropped);
+  for (unsigned char channel = 0; (SENSOR_CHANNELS > 1) && (channel < SENSOR_CHANNELS); channel++)
+  {
+    telemetry.print(F(","));
+    printTemperature(telemetry, TEMPERATURE_RAW(sensorTemperature[channel]));
+  }
+  telemetry.println();
+  telemetry.endRecord();
+}
+
+void sendTelemetryFrame(void)
+{
+  telemetryFrame_t frame;
+
+  telemetryFrameBuild(&frame, telemetrySequence++);
+  telemetry.beginRecord();
+  telemetry.write((const uint8_t *)&frame, sizeof(frame));
+  telemetry.endRecord();
+}
+
+// Binary record of the current PID sample, also the run log format
+void telemetryFrameBuild(telemetryFrame_t *frame, uint8_t sequence)
+{
+  uint8_t *ptr = (uint8_t *)frame;
+  uint16_t crc = 0xFFFF;
+  uint8_t count;
+
+  frame->sync = TELEMETRY_SYNC;
+  frame->version = TELEMETRY_VERSION;
+  frame->sequence = sequence;
+  frame->status = reflowState | (reflowProfile << 4);
+  frame->fault = fault;
+  frame->dropped = telemetry.dropped;
+  frame->time = timerSeconds;
+  frame->setpoint = TEMPERATURE_Q4(setpoint);
+  frame->input = TEMPERATURE_Q4(input);
+  frame->raw = TEMPERATURE_Q4(inputRaw);
+  frame->duty = ssrDuty;
+  for (count = 0; count < SENSOR_CHANNELS; count++)
+  {
+    frame->channel[count] = TEMPERATURE_Q4(TEMPERATURE_RAW(sensorTemperature[count]));
+    frame->channelFault[count] = sensorFault[count];
+  }
+
+  for (count = 0; count < offsetof(telemetryFrame_t, crc); count++)
+  {
+    crc = _crc_xmodem_update(crc, *ptr++);
+  }
+  frame->crc = crc;
+}
+
+#if RUN_LOG
+// Locate the first free index entry and the first erased page after the
+// last run, the log is append-only until erased
+void runLogBegin(void)
+{
+  runLogEntry_t entry;
+  uint8_t first;
+
+  digitalWrite(Board::flashCSPin, HIGH);
+  pinMode(Board::flashCSPin, OUTPUT);
+  flashSelect(FLASH_RELEASE_POWER_DOWN);
+  flashDeselect();
+  delayMicroseconds(30);
+
+  runLogPage = RUN_LOG_FIRST_PAGE;
+  for (runLogRuns = 0; runLogRuns < RUN_LOG_RUNS; runLogRuns++)
+  {
+    flashRead((uint32_t)runLogRuns * sizeof(entry), (uint8_t *)&entry, sizeof(entry));
+    if (entry.run == 0xFFFF) break;
+    runLogPage = entry.page;
+  }
+  while (runLogPage < RUN_LOG_PAGES)
+  {
+    flashRead((uint32_t)runLogPage * RUN_LOG_PAGE_SIZE, &first, 1);
+    if (first == 0xFF) break;
+    runLogPage++;
+  }
+}
+
+// New index entry, records start on the next free page
+void runLogStart(void)
+{
+  // Last run is still being flushed or the index is full
+  if (runLogActive || runLogPagePending || (runLogRuns >= RUN_LOG_RUNS) ||
+      (runLogPage >= RUN_LOG_PAGES) || runLogErasing)
+  {
+    return;
+  }
+  runLogEntry.run = runLogRuns;
+  runLogEntry.page = runLogPage;
+  runLogEntry.version = TELEMETRY_VERSION;
+  runLogEntry.recordSize = sizeof(telemetryFrame_t);
+  runLogEntry.result = 0xFF;
+  runLogFill = 0;
+  runLogSequence = 0;
+  runLogIndexPending = true;
+  runLogActive = true;
+}
+
+void runLogRecord(void)
+{
+  if (!runLogActive) return;
+  // Page full and not yet programmed, or no page left
+  if (runLogPagePending || (runLogPage >= RUN_LOG_PAGES))
+  {
+    runLogDropped++;
+    return;
+  }
+  telemetryFrameBuild((telemetryFrame_t *)&runLogBuffer[runLogFill], runLogSequence++);
+  runLogFill += sizeof(telemetryFrame_t);
+  if ((runLogFill + sizeof(telemetryFrame_t)) > RUN_LOG_PAGE_SIZE)
+  {
+    runLogPagePending = true;
+  }
+}
+
+// Start at most one flash operation per pass, never waiting for one
+void runLogTask(void)
+{
+  // Run ended: flush its last page and record how it ended
+  if (runLogActive && ((reflowStatus == REFLOW_STATUS_OFF) || (reflowState == REFLOW_STATE_REARM)))
+  {
+    runLogActive = false;
+    runLogEntry.result = reflowState;
+    runLogResultPending = true;
+    if (runLogFill != 0) runLogPagePending = true;
+  }
+
+  if (!runLogErasing && !runLogIndexPending && !runLogPagePending && !runLogResultPending &&
+      (runLogDumpAddress >= runLogDumpEnd))
+  {
+    return;
+  }
+  if (flashBusy()) return;
+
+  if (runLogErasing)
+  {
+    runLogErasing = false;
+    runLogRuns = 0;
+    runLogPage = RUN_LOG_FIRST_PAGE;
+  }
+  else if (runLogIndexPending)
+  {
+    runLogIndexPending = false;
+    // Known once the run has started, REFLOW_PROFILE_COUNT for a tune
+    runLogEntry.profile = (reflowState == REFLOW_STATE_TUNE) ? REFLOW_PROFILE_COUNT : reflowProfile;
+    flashProgram((uint32_t)runLogEntry.run * sizeof(runLogEntry), (const uint8_t *)&runLogEntry,
+                 offsetof(runLogEntry_t, result));
+    runLogRuns++;
+  }
+  else if (runLogPagePending)
+  {
+    flashProgram((uint32_t)runLogPage * RUN_LOG_PAGE_SIZE, runLogBuffer, runLogFill);
+    runLogPage++;
+    runLogFill = 0;
+    // Buffer is free again, the flash programs on its own
+    runLogPagePending = false;
+  }
+  else if (runLogResultPending)
+  {
+    // Erased bits of the entry can still be programmed
+    runLogResultPending = false;
+    flashProgram((uint32_t)runLogEntry.run * sizeof(runLogEntry) + offsetof(runLogEntry_t, result),
+                 &runLogEntry.result, 1);
+  }
+  else if (runLogDumpAddress < runLogDumpEnd)
+  {
+    runLogDump();
+  }
+}
+
+// Move the next chunk of a download to the telemetry buffer as room allows
+void runLogDump(void)
+{
+  uint8_t chunk[RUN_LOG_DUMP_CHUNK];
+  unsigned int length = min((uint32_t)RUN_LOG_DUMP_CHUNK, runLogDumpEnd - runLogDumpAddress);
+
+  if (telemetry.room() < length) return;
+  flashRead(runLogDumpAddress, chunk, length);
+  telemetry.beginRecord();
+  telemetry.write(chunk, length);
+  telemetry.endRecord();
+  runLogDumpAddress += length;
+}
+
+// Download the pages of a run, the index entry first
+bool runLogDumpStart(uint16_t run)
+{
+  runLogEntry_t entry;
+  uint16_t end = runLogPage;
+
+  if (runLogActive || runLogErasing || (run >= runLogRuns) || (runLogDumpAddress < runLogDumpEnd))
+  {
+    return false;
+  }
+  flashRead((uint32_t)run * sizeof(entry), (uint8_t *)&entry, sizeof(entry));
+  if ((run + 1) < runLogRuns)
+  {
+    flashRead((uint32_t)(run + 1) * sizeof(entry) + offsetof(runLogEntry_t, page),
+              (uint8_t *)&end, sizeof(end));
+  }
+
+  telemetry.beginRecord();
+  telemetry.print(F("log,"));
+  telemetry.print(run);
+  telemetry.print(F(","));
+  telemetry.print(entry.profile);
+  telemetry.print(F(","));
+  telemetry.print(entry.result);
+  telemetry.print(F(","));
+  telemetry.print(entry.recordSize);
+  telemetry.print(F(","));
+  telemetry.println((unsigned long)(end - entry.page) * RUN_LOG_PAGE_SIZE);
+  telemetry.endRecord();
+  runLogDumpAddress = (uint32_t)entry.page * RUN_LOG_PAGE_SIZE;
+  runLogDumpEnd = (uint32_t)end * RUN_LOG_PAGE_SIZE;
+
+  return true;
+}
+
+void runLogReport(Print &out)
+{
+  out.print(F("log,"));
+  out.print(runLogRuns);
+  out.print(F(","));
+  out.print(runLogPage);
+  out.print(F(","));
+  out.print(RUN_LOG_PAGES);
+  out.print(F(","));
+  out.println(runLogDropped);
+}
+
+void flashSelect(uint8_t command)
+{
+  SPI.beginTransaction(SPISettings(RUN_LOG_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+  digitalWrite(Board::flashCSPin, LOW);
+  SPI.transfer(command);
+}
+
+void flashDeselect(void)
+{
+  digitalWrite(Board::flashCSPin, HIGH);
+  SPI.endTransaction();
+}
+
+void flashAddress(uint32_t address)
+{
+  SPI.transfer(address >> 16);
+  SPI.transfer(address >> 8);
+  SPI.transfer(address);
+}
+
+bool flashBusy(void)
+{
+  uint8_t status;
+
+  flashSelect(FLASH_READ_STATUS);
+  status = SPI.transfer(0);
+  flashDeselect();
+
+  return status & FLASH_STATUS_BUSY;
+}
+
+void flashRead(uint32_t address, uint8_t *data, unsigned int length)
+{
+  flashSelect(FLASH_READ);
+  flashAddress(address);
+  while (length--)
+  {
+    *data++ = SPI.transfer(0);
+  }
+  flashDeselect();
+}
+
+// Within a single page, the flash is busy programming afterwards
+void flashProgram(uint32_t address, const uint8_t *data, unsigned int length)
+{
+  flashSelect(FLASH_WRITE_ENABLE);
+  flashDeselect();
+  flashSelect(FLASH_PAGE_PROGRAM);
+  flashAddress(address);
+  while (length--)
+  {
+    SPI.transfer(*data++);
+  }
+  flashDeselect();
+}
+#endif
+
+#if PROFILING
+void profileReset(void)
+{
+  unsigned char index;
+
+  for (index = 0; index < PROFILE_SECTIONS; index++)
+  {
+    profileStats[index].count = 0;
+    profileStats[index].total = 0;
+    profileStats[index].min = 0xFFFFFFFF;
+    profileStats[index].max = 0;
+  }
+  for (index = 0; index < TASK_COUNT; index++)
+  {
+    taskMissed[index] = 0;
+  }
+}
+
+void profileRecord(profileSection_t section, unsigned long duration)
+{
+  profileStats_t *stats = &profileStats[section];
+
+  stats->count++;
+  stats->total += duration;
+  if (duration < stats->min) stats->min = duration;
+  if (duration > stats->max) stats->max = duration;
+}
+
+// Statistics go out through the telemetry buffer a row per pass, between
+// whole records and without waiting on the UART
+void profileDump(void)
+{
+  profileDumpRow = 0;
+}
+
+// Send the next row once the widest one fits, a row is never dropped
+void profileDumpNext(void)
+{
+  unsigned char row = profileDumpRow;
+  char txtBuffer[8];
+
+  if (telemetry.room() < PROFILE_ROW_SIZE) return;
+  telemetry.beginRecord();
+  if (row == 0)
+  {
+    telemetry.println(F("Section,Count,Min,Max,Average (us)"));
+  }
+  else if (row <= PROFILE_SECTIONS)
+  {
+    profileStats_t *stats = &profileStats[row - 1];
+
+    strcpy_P(txtBuffer, (char *)pgm_read_word(&(profileSectionName[row - 1])));
+    telemetry.print(txtBuffer);
+    telemetry.print(F(","));
+    telemetry.print(stats->count);
+    telemetry.print(F(","));
+    telemetry.print(stats->count ? stats->min : 0);
+    telemetry.print(F(","));
+    telemetry.print(stats->max);
+    telemetry.print(F(","));
+    telemetry.println(stats->count ? (stats->total / stats->count) : 0);
+  }
+  else if (row == PROFILE_SECTIONS + 1)
+  {
+    // Deadline misses, in task table order
+    telemetry.println(F("Task,Missed"));
+  }
+  else
+  {
+    telemetry.print(row - PROFILE_SECTIONS - 2);
+    telemetry.print(F(","));
+    telemetry.println(taskMissed[row - PROFILE_SECTIONS - 2]);
+  }
+  telemetry.endRecord();
+  profileDumpRow++;
+}
+#endif
+
+#if BENCHMARK
+ISR(TIMER1_OVF_vect)
+{
+  benchOverflows++;
+}
+
+// Time each path under a free running Timer1, then halt. Under simavr the
+// sleep with interrupts disabled ends the simulation.
+void benchmarkRun(void)
+{
+  extern uint8_t __heap_start;
+  extern void *__brkval;
+  uint8_t *heapEnd = __brkval ? (uint8_t *)__brkval : &__heap_start;
+  uint8_t *lowest = (uint8_t *)RAMEND;
+  bench_t bench;
+  char txtBuffer[10];
+  uint8_t timerMask;
+
+  // The SSR stays off, Timer1 now counts CPU cycles. Only Timer1 bits are
+  // touched, the ATtiny1634 TIMSK also holds the millis() overflow.
+  digitalWrite(ssrPin, LOW);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    timerMask = TIMER1_MASK;
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+    TCNT1 = 0;
+    benchOverflows = 0;
+    TIMER1_FLAGS = _BV(TOV1);
+    TIMER1_MASK = (timerMask & ~_BV(OCIE1A)) | _BV(TOIE1);
+  }
+  // Cost of the timing calls themselves
+  benchRunCycles = 0;
+  benchBegin();
+  benchEnd();
+  benchOverhead = benchRunCycles;
+
+  // PID computes on every run, once per ms
+  reflowOvenPID.SetOutputLimits(0, windowSize);
+  reflowOvenPID.SetSampleTime(1);
+  reflowOvenPID.SetMode(AUTOMATIC);
+  setpoint = TEMPERATURE(TEMPERATURE_SOAK_MIN);
+
+  benchDrain();
+  Serial.println(F("Path,Runs,Min,Max,Stack"));
+  for (unsigned char index = 0; index < BENCH_COUNT; index++)
+  {
+    uint32_t min = 0xFFFFFFFF;
+    uint32_t max = 0;
+    uint16_t stack = 0;
+
+    memcpy_P(&bench, &benches[index], sizeof(bench));
+    for (unsigned char run = 0; run < BENCH_RUNS; run++)
+    {
+      uint8_t *low;
+
+      // Keep the UART interrupt out of the measurement
+      benchDrain();
+      benchPaint();
+      benchRunCycles = 0;
+      bench.run();
+      low = benchLowWater();
+      if (benchRunCycles < min) min = benchRunCycles;
+      if (benchRunCycles > max) max = benchRunCycles;
+      if ((uint16_t)(benchSp - low) > stack) stack = benchSp - low;
+      if (low < lowest) lowest = low;
+    }
+    strcpy_P(txtBuffer, bench.name);
+    Serial.print(txtBuffer);
+    Serial.print(F(","));
+    Serial.print(BENCH_RUNS);
+    Serial.print(F(","));
+    Serial.print(min);
+    Serial.print(F(","));
+    Serial.print(max);
+    Serial.print(F(","));
+    Serial.println(stack);
+  }
+  TIMER1_MASK = timerMask;
+
+  // Static data and the deepest stack seen over all paths
+  Serial.println(F("SRAM,Static,Peak,Size"));
+  Serial.print(F("SRAM,"));
+  Serial.print((uint16_t)(heapEnd - (uint8_t *)RAMSTART));
+  Serial.print(F(","));
+  Serial.print((uint16_t)(RAMEND + 1 - RAMSTART) - (uint16_t)(lowest - heapEnd));
+  Serial.print(F(","));
+  Serial.println(RAMEND + 1 - RAMSTART);
+  Serial.flush();
+
+  cli();
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  for (;;) sleep_cpu();
+}
+
+uint32_t benchCycles(void)
+{
+  uint16_t overflows;
+  uint16_t count;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    count = TCNT1;
+    overflows = benchOverflows;
+    // Overflowed before TCNT1 was read but not serviced yet
+    if ((TIMER1_FLAGS & _BV(TOV1)) && (count < 0x8000)) overflows++;
+  }
+  return ((uint32_t)overflows << 16) | count;
+}
+
+void benchBegin(void)
+{
+  benchSp = (uint8_t *)SP;
+  benchStart = benchCycles();
+}
+
+void benchEnd(void)
+{
+  benchRunCycles += benchCycles() - benchStart - benchOverhead;
+}
+
+// Empty the telemetry ring and the UART
+void benchDrain(void)
+{
+  for (unsigned char pass = 0; pass < 2; pass++)
+  {
+    telemetry.drain();
+    Serial.flush();
+  }
+}
+
+// Fill free SRAM between the heap and the current stack frame
+void benchPaint(void)
+{
+  extern uint8_t __heap_start;
+  extern void *__brkval;
+  uint8_t *cell = __brkval ? (uint8_t *)__brkval : &__heap_start;
+  uint8_t *end = (uint8_t *)SP - BENCH_STACK_GUARD;
+
+  while (cell < end) *cell++ = BENCH_PAINT;
+}
+
+// Lowest address the stack has reached since benchPaint()
+uint8_t *benchLowWater(void)
+{
+  extern uint8_t __heap_start;
+  extern void *__brkval;
+  uint8_t *cell = __brkval ? (uint8_t *)__brkval : &__heap_start;
+
+  while ((cell < (uint8_t *)SP) && (*cell == BENCH_PAINT)) cell++;
+  return cell;
+}
+
+void benchPid(void)
+{
+  unsigned long now = millis();
+
+  // Wait for the sample time to elapse
+  while (millis() == now);
+  // Vary the error so that no term saturates the same way every run
+  input = TEMPERATURE(TEMPERATURE_SOAK_MIN) - TEMPERATURE(now & 0x0F);
+  benchBegin();
+  reflowOvenPID.Compute();
+  benchEnd();
+}
+
+void benchSensor(void)
+{
+  benchBegin();
+  readThermocouple(0);
+  benchEnd();
+}
+
+void benchFormat(void)
+{
+  char text[TEMPERATURE_TEXT_SIZE];
+  pidValue_t value = TEMPERATURE((int16_t)(benchOverflows & 0xFF)) + TEMPERATURE_FROM_Q4(7);
+
+  benchBegin();
+  formatTemperature(text, value);
+  benchEnd();
+}
+
+// Record formatting into the ring, the UART is not involved
+void benchTelemetry(void)
+{
+  benchBegin();
+  sendTelemetry();
+  benchEnd();
+}
+
+// All pages of a frame, without sending them. The LCD is written while
+// rendering, so this covers its bus time.
+template <typename B>
+void benchRender(void)
+{
+  typedef typename B::Display Display;
+
+  benchBegin();
+  Display::firstPage();
+  do
+  {
+    Display::render();
+  } while (Display::nextPage());
+  benchEnd();
+}
+
+// Sending a full frame, every page is marked changed first
+template <typename B>
+void benchDisplay(void)
+{
+  typedef typename B::Display Display;
+
+  Display::invalidate();
+  Display::firstPage();
+  do
+  {
+    Display::render();
+    benchBegin();
+    Display::display();
+    benchEnd();
+  } while (Display::nextPage());
+}
+
+void benchLoop(void)
+{
+  benchBegin();
+  loop();
+  benchEnd();
+}
+#endif
@@ -0,0 +1,604 @@
+// Host implementation of the Arduino core and the libraries used by the
+// firmware, driven by a virtual millisecond clock
+#include <stdio.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <Wire.h>
+#include <EEPROM.h>
+#include <avr/eeprom.h>
+#include <Adafruit_GFX.h>
+#include <Adafruit_SSD1306.h>
+#include <Adafruit_MAX31856.h>
+extern "C" {
+#include <utility/twi.h>
+}
+#include "hal/sim.h"
+
+// ***** CLOCK *****
+unsigned long simTime;
+void (*simTick)(void);
+
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint8_t TIMSK1;
+volatile uint8_t TIFR1;
+volatile uint16_t OCR1A;
+volatile uint8_t PCICR;
+volatile uint8_t PCIFR;
+volatile uint8_t PCMSK0;
+volatile uint8_t PCMSK1;
+volatile uint8_t PCMSK2;
+
+// Defined by the firmware
+extern "C" void TIMER1_COMPA_vect(void);
+extern "C" void PCINT2_vect(void);
+
+void simAdvance(unsigned long ms)
+{
+  while (ms--)
+  {
+    simTime++;
+    // Timer1 is set up for a 1 ms compare match
+    if (TIMSK1 & _BV(OCIE1A)) TIMER1_COMPA_vect();
+    if (simTick) simTick();
+  }
+}
+
+unsigned long millis(void)
+{
+  return simTime;
+}
+
+// Time only moves between loop() passes
+unsigned long micros(void)
+{
+  return simTime * 1000;
+}
+
+void delay(unsigned long ms)
+{
+  simAdvance(ms);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+}
+
+// ***** PINS *****
+static uint8_t pinLevel[SIM_PINS];
+static bool pinDriven[SIM_PINS];
+static bool pinInputLow[SIM_PINS];
+static uint8_t drdyLevel = HIGH;
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin >= SIM_PINS) return;
+  pinLevel[pin] = value ? HIGH : LOW;
+  pinDriven[pin] = true;
+}
+
+// Lines never driven by the firmware are pulled up, switches are released
+int digitalRead(uint8_t pin)
+{
+  if (pin == SIM_DRDY_PIN) return drdyLevel;
+  if (pin >= SIM_PINS) return LOW;
+  if (pinDriven[pin]) return pinLevel[pin];
+  return pinInputLow[pin] ? LOW : HIGH;
+}
+
+// V1 switch ladder released
+int analogRead(uint8_t pin)
+{
+  return 1023;
+}
+
+uint8_t simPinRead(uint8_t pin)
+{
+  return (pin < SIM_PINS) ? pinLevel[pin] : LOW;
+}
+
+void simPinInput(uint8_t pin, uint8_t level)
+{
+  bool low = (level == LOW);
+
+  if ((pin >= SIM_PINS) || (pinInputLow[pin] == low)) return;
+  pinInputLow[pin] = low;
+  // Only port D changes are used, PCINT16 to PCINT23
+  if ((pin < 8) && (PCICR & _BV(PCIE2)) && (PCMSK2 & _BV(pin))) PCINT2_vect();
+}
+
+// ***** PRINT *****
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t count = 0;
+
+  while (size--) count += write(*buffer++);
+  return count;
+}
+
+size_t Print::print(const __FlashStringHelper *str)
+{
+  return write((const char *)str);
+}
+
+size_t Print::print(const char *str)
+{
+  return write(str);
+}
+
+size_t Print::print(char c)
+{
+  return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char n, int base)
+{
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(int n, int base)
+{
+  return print((long)n, base);
+}
+
+size_t Print::print(unsigned int n, int base)
+{
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(long n, int base)
+{
+  if ((base == DEC) && (n < 0))
+  {
+    return write('-') + printNumber(-(unsigned long)n, DEC);
+  }
+  return printNumber((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+  return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits)
+{
+  char text[32];
+
+  snprintf(text, sizeof(text), "%.*f", digits, n);
+  return write(text);
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base)
+{
+  char text[8 * sizeof(long) + 1];
+  char *cursor = &text[sizeof(text) - 1];
+
+  if (base < 2) base = 10;
+  *cursor = '\0';
+  do
+  {
+    unsigned char digit = n % base;
+
+    n /= base;
+    *--cursor = (digit < 10) ? ('0' + digit) : ('A' + digit - 10);
+  } while (n);
+  return write(cursor);
+}
+
+// Set while println() writes its line end
+static bool printLineEnd;
+
+size_t Print::println(void)
+{
+  printLineEnd = true;
+  size_t n = write("\r\n");
+  printLineEnd = false;
+  return n;
+}
+
+size_t Print::println(const __FlashStringHelper *str) { return print(str) + println(); }
+size_t Print::println(const char *str) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char n, int base) { return print(n, base) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+// ***** SERIAL *****
+HardwareSerial Serial;
+
+static char serialInput[256];
+static unsigned int serialHead;
+static unsigned int serialTail;
+
+void simSerialInput(const char *text)
+{
+  while (*text)
+  {
+    unsigned int next = (serialHead + 1) % sizeof(serialInput);
+
+    // Full, drop the rest like an overrun UART
+    if (next == serialTail) return;
+    serialInput[serialHead] = *text++;
+    serialHead = next;
+  }
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+}
+
+int HardwareSerial::available()
+{
+  return (serialHead - serialTail + sizeof(serialInput)) % sizeof(serialInput);
+}
+
+int HardwareSerial::read()
+{
+  int data = peek();
+
+  if (data >= 0) serialTail = (serialTail + 1) % sizeof(serialInput);
+  return data;
+}
+
+int HardwareSerial::peek()
+{
+  if (serialHead == serialTail) return -1;
+  return (unsigned char)serialInput[serialTail];
+}
+
+// Transmission completes instantly, a full hardware buffer is always free
+int HardwareSerial::availableForWrite()
+{
+  return 63;
+}
+
+void HardwareSerial::flush()
+{
+  fflush(stdout);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  // Keep stdout a plain CSV stream, only line ends lose their CR so binary
+  // records pass unchanged
+  if (!printLineEnd || (c != '\r')) putchar(c);
+  return 1;
+}
+
+// ***** EEPROM *****
+EEPROMClass EEPROM;
+
+static uint8_t eepromData[E2END + 1];
+static bool eepromErased;
+
+static uint8_t *eepromCell(int address)
+{
+  if (!eepromErased)
+  {
+    memset(eepromData, 0xFF, sizeof(eepromData));
+    eepromErased = true;
+  }
+  return &eepromData[(unsigned int)address % sizeof(eepromData)];
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+  return *eepromCell(address);
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+  *eepromCell(address) = value;
+}
+
+void EEPROMClass::update(int address, uint8_t value)
+{
+  *eepromCell(address) = value;
+}
+
+uint16_t EEPROMClass::length()
+{
+  return sizeof(eepromData);
+}
+
+bool eeprom_is_ready(void)
+{
+  return true;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address)
+{
+  return *eepromCell((int)(uintptr_t)address);
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value)
+{
+  *eepromCell((int)(uintptr_t)address) = value;
+}
+
+// ***** SPI NOR FLASH *****
+// Enough of a JEDEC flash for the run log: read, page program, chip erase
+// and the busy bit, with typical program and erase times
+#define FLASH_PROGRAM_TIME 1 // ms
+#define FLASH_ERASE_TIME 2000 // ms
+
+static uint8_t flashData[SIM_FLASH_SIZE];
+static bool flashErased;
+static uint8_t flashCommand;
+static uint8_t flashPhase;
+static uint32_t flashAddress;
+static bool flashWriteEnabled;
+static bool flashProgramming;
+static unsigned long flashBusyUntil;
+
+static bool flashSelected(void)
+{
+  return pinDriven[SIM_FLASH_CS_PIN] && (pinLevel[SIM_FLASH_CS_PIN] == LOW);
+}
+
+static uint8_t flashTransfer(uint8_t data)
+{
+  bool busy = simTime < flashBusyUntil;
+
+  if (!flashErased)
+  {
+    memset(flashData, 0xFF, sizeof(flashData));
+    flashErased = true;
+  }
+  if (flashPhase == 0)
+  {
+    flashCommand = data;
+    flashPhase = 1;
+    flashProgramming = false;
+    if (data == 0x06) flashWriteEnabled = true;
+    if ((data == 0xC7) && flashWriteEnabled && !busy)
+    {
+      memset(flashData, 0xFF, sizeof(flashData));
+      flashWriteEnabled = false;
+      flashBusyUntil = simTime + FLASH_ERASE_TIME;
+    }
+    return 0;
+  }
+  switch (flashCommand)
+  {
+    case 0x05:
+      return (busy ? 0x01 : 0) | (flashWriteEnabled ? 0x02 : 0);
+
+    case 0x03:
+    case 0x02:
+      if (flashPhase < 4)
+      {
+        flashAddress = (flashAddress << 8) | data;
+        if (++flashPhase < 4) return 0;
+        flashAddress %= SIM_FLASH_SIZE;
+        if (flashCommand == 0x02)
+        {
+          flashProgramming = flashWriteEnabled && !busy;
+          flashWriteEnabled = false;
+        }
+        return 0;
+      }
+      if (flashCommand == 0x03)
+      {
+        uint8_t result = flashData[flashAddress];
+        flashAddress = (flashAddress + 1) % SIM_FLASH_SIZE;
+        return result;
+      }
+      // Programming only clears bits, the address wraps within the page
+      if (flashProgramming)
+      {
+        flashData[flashAddress] &= data;
+        flashAddress = (flashAddress & ~0xFFUL) | ((flashAddress + 1) & 0xFF);
+        flashBusyUntil = simTime + FLASH_PROGRAM_TIME;
+      }
+      return 0;
+
+    default:
+      return 0;
+  }
+}
+
+// ***** MAX31856 *****
+SPIClass SPI;
+
+static uint8_t thermocoupleRegister[16];
+static int8_t spiAddress;
+static bool spiWrite;
+
+void simThermocouple(double temperature, uint8_t fault)
+{
+  // Linearized temperature, 19 bits left justified (LSB = 1/128 degree Celsius)
+  int32_t code = (int32_t)lround(temperature * 128);
+  uint32_t value;
+
+  code = constrain(code, -(1L << 18), (1L << 18) - 1);
+  value = ((uint32_t)code << 5) & 0xFFFFFF;
+  thermocoupleRegister[MAX31856_LTCBH_REG] = value >> 16;
+  thermocoupleRegister[MAX31856_LTCBM_REG] = value >> 8;
+  thermocoupleRegister[MAX31856_LTCBL_REG] = value;
+  thermocoupleRegister[MAX31856_SR_REG] = fault;
+  drdyLevel = LOW;
+  // FAULT follows the unmasked status bits (comparator mode)
+  simPinInput(SIM_FAULT_PIN, (fault & ~thermocoupleRegister[MAX31856_MASK_REG]) ? LOW : HIGH);
+}
+
+void SPIClass::begin()
+{
+}
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+  spiAddress = -1;
+  flashPhase = 0;
+}
+
+void SPIClass::endTransaction()
+{
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  uint8_t result = 0;
+
+  if (flashSelected()) return flashTransfer(data);
+  if (spiAddress < 0)
+  {
+    spiWrite = data & 0x80;
+    spiAddress = data & 0x0F;
+    return 0;
+  }
+  if (spiWrite) thermocoupleRegister[spiAddress] = data;
+  else result = thermocoupleRegister[spiAddress];
+  // Reading the temperature clears DRDY
+  if (!spiWrite && (spiAddress == MAX31856_LTCBH_REG)) drdyLevel = HIGH;
+  spiAddress = (spiAddress + 1) & 0x0F;
+  return result;
+}
+
+// ***** I2C *****
+TwoWire Wire;
+
+void TwoWire::begin() {}
+void TwoWire::setClock(uint32_t clock) {}
+void TwoWire::beginTransmission(uint8_t address) {}
+uint8_t TwoWire::endTransmission(bool sendStop) { return 0; }
+size_t TwoWire::write(uint8_t data) { return 1; }
+int TwoWire::available() { return 0; }
+int TwoWire::read() { return -1; }
+int TwoWire::peek() { return -1; }
+
+uint8_t twi_writeTo(uint8_t address, uint8_t *data, uint8_t length, uint8_t wait, uint8_t sendStop)
+{
+  return 0;
+}
+
+// ***** GRAPHICS *****
+Adafruit_GFX::Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h)
+{
+  _width = w;
+  _height = h;
+  cursor_x = 0;
+  cursor_y = 0;
+  textcolor = textbgcolor = 0xFFFF;
+  textsize_x = textsize_y = 1;
+}
+
+void Adafruit_GFX::writeLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
+{
+  int16_t dx = abs(x1 - x0);
+  int16_t dy = -abs(y1 - y0);
+  int16_t sx = (x0 < x1) ? 1 : -1;
+  int16_t sy = (y0 < y1) ? 1 : -1;
+  int16_t error = dx + dy;
+
+  for (;;)
+  {
+    writePixel(x0, y0, color);
+    if ((x0 == x1) && (y0 == y1)) break;
+    if (2 * error >= dy)
+    {
+      error += dy;
+      x0 += sx;
+    }
+    if (2 * error <= dx)
+    {
+      error += dx;
+      y0 += sy;
+    }
+  }
+}
+
+void Adafruit_GFX::drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color)
+{
+  while (h-- > 0) drawPixel(x, y++, color);
+}
+
+void Adafruit_GFX::drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color)
+{
+  while (w-- > 0) drawPixel(x++, y, color);
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+  for (int16_t column = x; column < x + w; column++) drawFastVLine(column, y, h, color);
+}
+
+void Adafruit_GFX::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color)
+{
+  if (x0 == x1) drawFastVLine(x0, min(y0, y1), abs(y1 - y0) + 1, color);
+  else if (y0 == y1) drawFastHLine(min(x0, x1), y0, abs(x1 - x0) + 1, color);
+  else writeLine(x0, y0, x1, y1, color);
+}
+
+void Adafruit_GFX::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color)
+{
+  drawFastHLine(x, y, w, color);
+  drawFastHLine(x, y + h - 1, w, color);
+  drawFastVLine(x, y, h, color);
+  drawFastVLine(x + w - 1, y, h, color);
+}
+
+// Classic 6x8 font cell, glyphs are not rendered
+size_t Adafruit_GFX::write(uint8_t c)
+{
+  if (c == '\n')
+  {
+    cursor_x = 0;
+    cursor_y += textsize_y * 8;
+  }
+  else if (c != '\r')
+  {
+    cursor_x += textsize_x * 6;
+  }
+  return 1;
+}
+
+Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi, int8_t rst_pin,
+                                   uint32_t clkDuring, uint32_t clkAfter)
+  : Adafruit_GFX(w, h), wire(twi), buffer(NULL), i2caddr(0), vccstate(0),
+    wireClk(clkDuring), restoreClk(clkAfter)
+{
+}
+
+Adafruit_SSD1306::~Adafruit_SSD1306(void)
+{
+  free(buffer);
+  buffer = NULL;
+}
+
+bool Adafruit_SSD1306::begin(uint8_t switchvcc, uint8_t addr, bool reset, bool periphBegin)
+{
+  if (!buffer && !(buffer = (uint8_t *)malloc(WIDTH * ((HEIGHT + 7) / 8)))) return false;
+  clearDisplay();
+  vccstate = switchvcc;
+  i2caddr = addr;
+  return true;
+}
+
+void Adafruit_SSD1306::clearDisplay(void)
+{
+  memset(buffer, 0, WIDTH * ((HEIGHT + 7) / 8));
+}
+
+void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color)
+{
+  uint8_t *cell;
+
+  if ((x < 0) || (x >= WIDTH) || (y < 0) || (y >= HEIGHT)) return;
+  cell = &buffer[x + (y / 8) * WIDTH];
+  switch (color)
+  {
+    case SSD1306_WHITE: *cell |= (1 << (y & 7)); break;
+    case SSD1306_BLACK: *cell &= ~(1 << (y & 7)); break;
+    case SSD1306_INVERSE: *cell ^= (1 << (y & 7)); break;
+  }
+}
@@ -0,0 +1,40 @@
+// Register map of the library, the firmware talks to the devices through SPI.h
+#ifndef ADAFRUIT_MAX31856_H
+#define ADAFRUIT_MAX31856_H
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#define MAX31856_CR0_REG 0x00
+#define MAX31856_CR0_AUTOCONVERT 0x80
+#define MAX31856_CR0_OCFAULT0 0x10
+#define MAX31856_CR1_REG 0x01
+#define MAX31856_MASK_REG 0x02
+#define MAX31856_CJTO_REG 0x09
+#define MAX31856_LTCBH_REG 0x0C
+#define MAX31856_LTCBM_REG 0x0D
+#define MAX31856_LTCBL_REG 0x0E
+#define MAX31856_SR_REG 0x0F
+
+#define MAX31856_FAULT_CJRANGE 0x80
+#define MAX31856_FAULT_TCRANGE 0x40
+#define MAX31856_FAULT_CJHIGH 0x20
+#define MAX31856_FAULT_CJLOW 0x10
+#define MAX31856_FAULT_TCHIGH 0x08
+#define MAX31856_FAULT_TCLOW 0x04
+#define MAX31856_FAULT_OVUV 0x02
+#define MAX31856_FAULT_OPEN 0x01
+
+typedef enum
+{
+  MAX31856_TCTYPE_B = 0,
+  MAX31856_TCTYPE_E = 1,
+  MAX31856_TCTYPE_J = 2,
+  MAX31856_TCTYPE_K = 3,
+  MAX31856_TCTYPE_N = 4,
+  MAX31856_TCTYPE_R = 5,
+  MAX31856_TCTYPE_S = 6,
+  MAX31856_TCTYPE_T = 7
+} max31856_thermocoupletype_t;
+
+#endif
@@ -0,0 +1,65 @@
+// Frame buffer in RAM, commands are dropped
+#ifndef _Adafruit_SSD1306_H_
+#define _Adafruit_SSD1306_H_
+
+#include <Adafruit_GFX.h>
+#include <Wire.h>
+#include <SPI.h>
+
+#define BLACK 0
+#define WHITE 1
+#define INVERSE 2
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_INVERSE 2
+
+#define SSD1306_MEMORYMODE 0x20
+#define SSD1306_COLUMNADDR 0x21
+#define SSD1306_PAGEADDR 0x22
+#define SSD1306_SETCONTRAST 0x81
+#define SSD1306_CHARGEPUMP 0x8D
+#define SSD1306_SEGREMAP 0xA0
+#define SSD1306_DISPLAYALLON_RESUME 0xA4
+#define SSD1306_NORMALDISPLAY 0xA6
+#define SSD1306_SETMULTIPLEX 0xA8
+#define SSD1306_DISPLAYOFF 0xAE
+#define SSD1306_DISPLAYON 0xAF
+#define SSD1306_COMSCANDEC 0xC8
+#define SSD1306_SETDISPLAYOFFSET 0xD3
+#define SSD1306_SETDISPLAYCLOCKDIV 0xD5
+#define SSD1306_SETPRECHARGE 0xD9
+#define SSD1306_SETCOMPINS 0xDA
+#define SSD1306_SETVCOMDETECT 0xDB
+#define SSD1306_SETSTARTLINE 0x40
+#define SSD1306_DEACTIVATE_SCROLL 0x2E
+#define SSD1306_EXTERNALVCC 0x01
+#define SSD1306_SWITCHCAPVCC 0x02
+
+class Adafruit_SSD1306 : public Adafruit_GFX
+{
+public:
+  Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi = &Wire, int8_t rst_pin = -1,
+                   uint32_t clkDuring = 400000UL, uint32_t clkAfter = 100000UL);
+  ~Adafruit_SSD1306(void);
+
+  bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t i2caddr = 0,
+             bool reset = true, bool periphBegin = true);
+  void display(void) {}
+  void clearDisplay(void);
+  void drawPixel(int16_t x, int16_t y, uint16_t color);
+  void ssd1306_command(uint8_t c) {}
+  uint8_t *getBuffer(void) { return buffer; }
+
+protected:
+  void ssd1306_command1(uint8_t c) {}
+  void ssd1306_commandList(const uint8_t *c, uint8_t n) {}
+
+  TwoWire *wire;
+  uint8_t *buffer;
+  int8_t i2caddr;
+  int8_t vccstate;
+  uint32_t wireClk;
+  uint32_t restoreClk;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <Arduino.h>
+
+// E2END + 1 bytes, erased on every simulator start
+struct EEPROMClass
+{
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  void update(int address, uint8_t value);
+  uint16_t length();
+
+  template <typename T> T &get(int address, T &t)
+  {
+    uint8_t *data = (uint8_t *)&t;
+
+    for (unsigned int index = 0; index < sizeof(T); index++) data[index] = read(address + index);
+    return t;
+  }
+
+  template <typename T> const T &put(int address, const T &t)
+  {
+    const uint8_t *data = (const uint8_t *)&t;
+
+    for (unsigned int index = 0; index < sizeof(T); index++) update(address + index, data[index]);
+    return t;
+  }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
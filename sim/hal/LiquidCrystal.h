@@ -0,0 +1,19 @@
+// Characters are accepted and dropped
+#ifndef LiquidCrystal_h
+#define LiquidCrystal_h
+
+#include <Arduino.h>
+
+class LiquidCrystal : public Print
+{
+public:
+  LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3) {}
+  void begin(uint8_t cols, uint8_t rows) {}
+  void clear() {}
+  void setCursor(uint8_t col, uint8_t row) {}
+  void createChar(uint8_t location, const uint8_t charmap[]) {}
+  virtual size_t write(uint8_t c) { return 1; }
+  using Print::write;
+};
+
+#endif
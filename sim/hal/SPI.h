@@ -0,0 +1,30 @@
+// Transfers reach the emulated MAX31856 register file
+#ifndef _SPI_H_INCLUDED
+#define _SPI_H_INCLUDED
+
+#include <Arduino.h>
+
+#define MSBFIRST 1
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+
+class SPISettings
+{
+public:
+  SPISettings() {}
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {}
+};
+
+class SPIClass
+{
+public:
+  static void begin();
+  // Starts a register access, the next byte is the address
+  static void beginTransaction(SPISettings settings);
+  static void endTransaction();
+  static uint8_t transfer(uint8_t data);
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <Arduino.h>
+
+#define BUFFER_LENGTH 32
+
+class TwoWire : public Stream
+{
+public:
+  void begin();
+  void setClock(uint32_t clock);
+  void beginTransmission(uint8_t address);
+  uint8_t endTransmission(bool sendStop = true);
+  size_t write(uint8_t data);
+  using Print::write;
+  int available();
+  int read();
+  int peek();
+};
+
+extern TwoWire Wire;
+
+#endif
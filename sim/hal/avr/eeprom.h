@@ -0,0 +1,11 @@
+#ifndef _AVR_EEPROM_H_
+#define _AVR_EEPROM_H_
+
+#include <stdint.h>
+
+// Writes complete immediately on the host
+bool eeprom_is_ready(void);
+uint8_t eeprom_read_byte(const uint8_t *address);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+
+#endif
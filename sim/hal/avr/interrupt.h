@@ -0,0 +1,10 @@
+// Interrupt vectors are plain functions called by simAdvance()
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+
+#define ISR(vector) extern "C" void vector(void); extern "C" void vector(void)
+
+static inline void sei(void) {}
+static inline void cli(void) {}
+
+#endif
@@ -0,0 +1,41 @@
+// ATmega328P registers touched by the firmware, plain variables on the host
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+
+#include <stdint.h>
+
+#define F_CPU 8000000UL
+#define E2END 0x3FF
+
+#define _BV(bit) (1 << (bit))
+
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TIMSK1;
+extern volatile uint8_t TIFR1;
+extern volatile uint16_t OCR1A;
+extern volatile uint8_t PCICR;
+extern volatile uint8_t PCIFR;
+extern volatile uint8_t PCMSK0;
+extern volatile uint8_t PCMSK1;
+extern volatile uint8_t PCMSK2;
+#define TCCR1A TCCR1A
+#define TCCR1B TCCR1B
+#define TIMSK1 TIMSK1
+#define TIFR1 TIFR1
+#define OCR1A OCR1A
+#define PCICR PCICR
+#define PCIFR PCIFR
+#define PCMSK0 PCMSK0
+#define PCMSK1 PCMSK1
+#define PCMSK2 PCMSK2
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define OCIE1A 1
+#define OCF1A 1
+#define PCIE2 2
+
+#endif
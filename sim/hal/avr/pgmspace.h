@@ -0,0 +1,24 @@
+// Flash and RAM share one address space on the host
+#ifndef __PGMSPACE_H_
+#define __PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+// Wider reads keep the pointed type, pointer tables hold 8 byte entries here
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(address))
+#define pgm_read_dword(address) (*(address))
+#define pgm_read_ptr(address) (*(address))
+
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+
+#endif
@@ -0,0 +1,14 @@
+// Time only moves between loop() passes, sleeping until the next tick is
+// what the runner does anyway
+#ifndef _AVR_SLEEP_H_
+#define _AVR_SLEEP_H_
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_PWR_DOWN 2
+
+static inline void set_sleep_mode(int mode) {}
+static inline void sleep_enable(void) {}
+static inline void sleep_disable(void) {}
+static inline void sleep_cpu(void) {}
+
+#endif
@@ -0,0 +1,33 @@
+// Hooks between the mocked Arduino HAL and the oven simulator
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+// V2 board wiring seen by the simulator
+#define SIM_SSR_PIN 14 // A0
+#define SIM_FAN_PIN 15 // A1
+#define SIM_BUZZER_PIN 5
+#define SIM_SWITCH1_PIN 3 // Start/stop, active low
+#define SIM_DRDY_PIN 9
+#define SIM_FAULT_PIN 7 // MAX31856 FAULT, active low
+#define SIM_FLASH_CS_PIN 8 // Run log SPI NOR flash
+#define SIM_FLASH_SIZE 0x100000UL
+#define SIM_PINS 32
+
+// Virtual clock (ms), advanced by the runner and by delay()
+extern unsigned long simTime;
+// Called once per virtual ms, after the Timer1 ISR
+extern void (*simTick)(void);
+
+void simAdvance(unsigned long ms);
+// Level last driven on a pin by the firmware
+uint8_t simPinRead(uint8_t pin);
+// Level applied to an input pin, raises its pin change interrupt
+void simPinInput(uint8_t pin, uint8_t level);
+// Latch a conversion result into the MAX31856 registers
+void simThermocouple(double temperature, uint8_t fault);
+// Queue bytes for Serial.read()
+void simSerialInput(const char *text);
+
+#endif
@@ -0,0 +1,9 @@
+// Single threaded on the host, interrupts run between loop() passes
+#ifndef _UTIL_ATOMIC_H_
+#define _UTIL_ATOMIC_H_
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 1
+#define ATOMIC_BLOCK(type) for (int atomicOnce = 1; atomicOnce; atomicOnce = 0)
+
+#endif
@@ -0,0 +1,29 @@
+// Reference implementations from the avr-libc documentation
+#ifndef _UTIL_CRC16_H_
+#define _UTIL_CRC16_H_
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t data)
+{
+  crc ^= data;
+  for (uint8_t bit = 0; bit < 8; bit++)
+  {
+    if (crc & 1) crc = (crc >> 1) ^ 0xA001;
+    else crc >>= 1;
+  }
+  return crc;
+}
+
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data)
+{
+  crc ^= (uint16_t)data << 8;
+  for (uint8_t bit = 0; bit < 8; bit++)
+  {
+    if (crc & 0x8000) crc = (crc << 1) ^ 0x1021;
+    else crc <<= 1;
+  }
+  return crc;
+}
+
+#endif
@@ -0,0 +1,11 @@
+// Frames are accepted and dropped, the panel is not simulated
+#ifndef twi_h
+#define twi_h
+
+#include <stdint.h>
+
+#define TWI_BUFFER_LENGTH 32
+
+uint8_t twi_writeTo(uint8_t address, uint8_t *data, uint8_t length, uint8_t wait, uint8_t sendStop);
+
+#endif
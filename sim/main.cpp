@@ -0,0 +1,171 @@
+// Runs the firmware against a simulated oven on a virtual clock. The CSV
+// telemetry of the firmware goes to stdout, a run summary to stderr.
+//
+//   sim [-p power] [-E element mass] [-k coupling] [-m mass] [-l loss]
+//       [-F fan loss] [-a ambient] [-s sensor lag] [-n noise] [-r seed]
+//       [-t duration] [-f fault time] [-c command]... [-C confirm period]
+//       [-b runs] [-S press time]
+//
+// Commands are sent over the serial port after start-up, "start" when none
+// is given, and "start" again every confirm period (s) for batches. A
+// command given as "@<s> <command>" is sent that many seconds in instead. The
+// start/stop switch is pressed with contact bounce at the press time (s). The
+// run ends when the buzzer has sounded the given number of times (1) or
+// after the duration (s). Exit status is 0 when the runs completed.
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "oven.h"
+#include "hal/sim.h"
+
+#define SIM_CONVERSION_TIME 100 // MAX31856 continuous conversion period (ms)
+#define SIM_DURATION 1200 // Default run limit (s)
+#define SIM_PRESS_TIME 300 // Switch held down (ms)
+#define SIM_BOUNCE_TIME 5 // Contact bounce after press and release (ms)
+
+void setup(void);
+void loop(void);
+
+static Oven oven;
+static unsigned long faultTime;
+static unsigned long pressTime;
+static unsigned long conversionTime;
+static double peak;
+
+// One virtual ms of oven physics and thermocouple conversions
+static void ovenTick(void)
+{
+  oven.step(simPinRead(SIM_SSR_PIN), simPinRead(SIM_FAN_PIN), 0.001);
+  if (oven.chamber > peak) peak = oven.chamber;
+  if (simTime - conversionTime >= SIM_CONVERSION_TIME)
+  {
+    conversionTime = simTime;
+    // MAX31856_FAULT_OPEN
+    simThermocouple(oven.sample(), (faultTime && (simTime >= faultTime)) ? 0x01 : 0);
+  }
+  if (pressTime && (simTime >= pressTime))
+  {
+    unsigned long held = simTime - pressTime;
+    uint8_t level = (held < SIM_PRESS_TIME) ? 0 : 1;
+
+    // Contacts toggle every ms while bouncing
+    if ((held % SIM_PRESS_TIME) < SIM_BOUNCE_TIME) level = held & 1;
+    simPinInput(SIM_SWITCH1_PIN, level);
+    if (held >= SIM_PRESS_TIME + SIM_BOUNCE_TIME) pressTime = 0;
+  }
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-p W] [-E J/K] [-k W/K] [-m J/K] [-l W/K] [-F W/K] [-a C] [-s s] "
+                  "[-n C] [-r seed] [-t s] [-f s] [-c command]... [-C s] [-b runs] [-S s]\n", name);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  const char *commands[16];
+  unsigned long commandTimes[16];
+  unsigned int commandCount = 0;
+  unsigned long duration = SIM_DURATION;
+  unsigned long confirmPeriod = 0;
+  unsigned long confirmTime;
+  unsigned int runs = 1;
+  bool buzzer = false;
+  bool complete = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "p:E:k:m:l:F:a:s:n:r:t:f:c:C:b:S:")) != -1)
+  {
+    switch (option)
+    {
+      case 'p': oven.power = atof(optarg); break;
+      case 'E': oven.elementMass = atof(optarg); break;
+      case 'k': oven.coupling = atof(optarg); break;
+      case 'm': oven.mass = atof(optarg); break;
+      case 'l': oven.loss = atof(optarg); break;
+      case 'F': oven.fanLoss = atof(optarg); break;
+      case 'a': oven.ambient = atof(optarg); break;
+      case 's': oven.sensorLag = atof(optarg); break;
+      case 'n': oven.noise = atof(optarg); break;
+      case 'r': oven.seed = strtoul(optarg, NULL, 0); break;
+      case 't': duration = strtoul(optarg, NULL, 0); break;
+      case 'f': faultTime = strtoul(optarg, NULL, 0) * 1000; break;
+      case 'C': confirmPeriod = strtoul(optarg, NULL, 0) * 1000; break;
+      case 'b': runs = strtoul(optarg, NULL, 0); break;
+      case 'S': pressTime = strtoul(optarg, NULL, 0) * 1000; break;
+      case 'c':
+        if (commandCount == sizeof(commands) / sizeof(commands[0])) usage(argv[0]);
+        commandTimes[commandCount] = 0;
+        if (optarg[0] == '@')
+        {
+          char *end;
+
+          commandTimes[commandCount] = strtoul(optarg + 1, &end, 0) * 1000;
+          if (*end != ' ') usage(argv[0]);
+          optarg = end + 1;
+        }
+        commands[commandCount++] = optarg;
+        break;
+      default: usage(argv[0]);
+    }
+  }
+  if (commandCount == 0)
+  {
+    commandTimes[commandCount] = 0;
+    commands[commandCount++] = "start";
+  }
+
+  oven.reset();
+  peak = oven.chamber;
+  simTick = ovenTick;
+  // First conversion is ready shortly after power-up
+  simThermocouple(oven.sample(), 0);
+  setup();
+
+  // Relative to the end of the splash screens
+  duration = simTime + duration * 1000;
+  if (faultTime) faultTime += simTime;
+  if (pressTime) pressTime += simTime;
+  for (unsigned int index = 0; index < commandCount; index++)
+  {
+    commandTimes[index] += simTime;
+  }
+  confirmTime = simTime + confirmPeriod;
+
+  while (simTime < duration)
+  {
+    for (unsigned int index = 0; index < commandCount; index++)
+    {
+      if (commands[index] && (simTime >= commandTimes[index]))
+      {
+        simSerialInput(commands[index]);
+        simSerialInput("\n");
+        commands[index] = NULL;
+      }
+    }
+    loop();
+    simAdvance(1);
+    if (confirmPeriod && (simTime >= confirmTime))
+    {
+      confirmTime += confirmPeriod;
+      simSerialInput("start\n");
+    }
+    // Count rising edges, the buzzer sounds for a second per completion
+    if (simPinRead(SIM_BUZZER_PIN) != buzzer)
+    {
+      buzzer = !buzzer;
+      if (buzzer && (--runs == 0))
+      {
+        complete = true;
+        break;
+      }
+    }
+  }
+  fflush(stdout);
+
+  fprintf(stderr, "%s at %lu s, peak %.1f C\n", complete ? "complete" : "timeout",
+          simTime / 1000, peak);
+  return complete ? 0 : 1;
+}
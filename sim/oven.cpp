@@ -0,0 +1,28 @@
+#include "oven.h"
+
+void Oven::reset(void)
+{
+  element = ambient;
+  chamber = ambient;
+  sensor = ambient;
+  random = seed;
+}
+
+// Forward Euler, dt well below the smallest time constant
+void Oven::step(bool heating, bool fan, double dt)
+{
+  double transfer = coupling * (element - chamber);
+  double conductance = loss + (fan ? fanLoss : 0);
+
+  element += dt * ((heating ? power : 0) - transfer) / elementMass;
+  chamber += dt * (transfer - conductance * (chamber - ambient)) / mass;
+  sensor += dt * (chamber - sensor) / sensorLag;
+}
+
+double Oven::sample(void)
+{
+  if (noise == 0) return sensor;
+  // Numerical Recipes LCG, reproducible for a given seed
+  random = random * 1664525 + 1013904223;
+  return sensor + noise * ((double)(random >> 8) / (1 << 23) - 1);
+}
@@ -0,0 +1,37 @@
+// Lumped thermal model of a convection or toaster oven
+#ifndef OVEN_H
+#define OVEN_H
+
+#include <stdint.h>
+
+class Oven
+{
+public:
+  // Heating element, warms up before the chamber does
+  double power = 1800; // At full on (W)
+  double elementMass = 400; // Heat capacity (J/K)
+  double coupling = 10; // Element to chamber conductance (W/K)
+  // Chamber air, trays and board
+  double mass = 900; // Heat capacity (J/K)
+  double loss = 6; // Chamber to ambient conductance (W/K)
+  double fanLoss = 20; // Added by the cooling fan at full speed (W/K)
+  double ambient = 25; // Degree Celsius
+  // Thermocouple bead
+  double sensorLag = 2; // Time constant (s)
+  double noise = 0; // Peak uniform noise on each conversion (degree Celsius)
+  uint32_t seed = 1;
+
+  double element;
+  double chamber;
+  double sensor;
+
+  void reset(void);
+  void step(bool heating, bool fan, double dt);
+  // Thermocouple reading including noise
+  double sample(void);
+
+private:
+  uint32_t random;
+};
+
+#endif